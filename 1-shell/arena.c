@@ -2,27 +2,129 @@
 #include "mc.h"
 
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+// Size of a regular chunk, including its header.
+#define CHUNK_SIZE 8192
+
+// Allocations larger than this do not come from a chunk but get their own
+// malloc, so a single big allocation does not waste most of a chunk.
+#define LARGE_ALLOC (CHUNK_SIZE / 4)
+
+// The maximum number of free chunks that is kept around for reuse.
+#define MAX_RETAINED_CHUNKS 16
+
+#define ALIGNMENT (_Alignof(max_align_t))
+#define ALIGN_UP(n) (((n) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+// A chunk of memory that is handed out with a bump pointer. All chunks in use
+// form a stack, the newest chunk is `cur_chunk`.
+struct chunk {
+	struct chunk *prev;
+	size_t used;
+};
+
+// An allocation that was too large for a chunk.
+struct large {
+	struct large *next;
+};
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(struct chunk))
+#define LARGE_HEADER ALIGN_UP(sizeof(struct large))
+
+// The arena's themselves live inside the chunks. As memory can only be
+// allocated in the current arena, arena's are popped in the reverse order of
+// the chunks, so popping an arena only has to reset the bump pointer to where
+// it was when the arena was pushed.
 struct arena;
 struct arena {
 	struct arena *next;
-	mc *m;
+	struct chunk *chunk; // `cur_chunk` when this arena was pushed.
+	size_t used;         // `cur_chunk->used` when this arena was pushed.
+	struct large *large;
+	mc *foreign;         // Memory registered with `arena_register_mem`.
 };
 
 static struct arena *cur_arena = NULL;
+static size_t n_arenas = 0;
+static struct chunk *cur_chunk = NULL;
+static struct chunk *free_chunks = NULL;
+static size_t n_free_chunks = 0;
 int dealloc_on_pop_all = 1;
+struct arena_stats arena_stats;
+
+static struct chunk *get_chunk(void)
+{
+	struct chunk *c = free_chunks;
+
+	if (c) {
+		free_chunks = c->prev;
+		n_free_chunks--;
+	} else {
+		c = malloc(CHUNK_SIZE);
+		if (NULL == c)
+			exit(EXIT_FAILURE);
+		arena_stats.mallocs++;
+	}
+
+	c->prev = cur_chunk;
+	c->used = CHUNK_HEADER;
+	cur_chunk = c;
+	return c;
+}
+
+static void put_chunk(struct chunk *c)
+{
+	if (n_free_chunks >= MAX_RETAINED_CHUNKS) {
+		free(c);
+		return;
+	}
+	c->prev = free_chunks;
+	free_chunks = c;
+	n_free_chunks++;
+}
+
+// Bump allocate `size` bytes from the current chunk, taking a new chunk if the
+// current one is full. `size` must not be larger than `LARGE_ALLOC`.
+static void *bump(size_t size)
+{
+	size = ALIGN_UP(size);
+	if (!cur_chunk || cur_chunk->used + size > CHUNK_SIZE)
+		get_chunk();
+
+	void *res = (char *)cur_chunk + cur_chunk->used;
+	cur_chunk->used += size;
+	return res;
+}
 
 void arena_push(void)
 {
-	struct arena *a;
-	mc *m = mc_init();
+	struct chunk *chunk = cur_chunk;
+	size_t used = chunk ? chunk->used : 0;
+	struct arena *a = bump(sizeof(struct arena));
 
-	a = mc_calloc(m, 1, sizeof(struct arena));
 	a->next = cur_arena;
-	a->m = m;
+	a->chunk = chunk;
+	a->used = used;
+	a->large = NULL;
+	a->foreign = NULL;
 	cur_arena = a;
+	n_arenas++;
+	arena_stats.pushes++;
+}
+
+static void free_chunks_all(void)
+{
+	while (free_chunks) {
+		struct chunk *prev = free_chunks->prev;
+		free(free_chunks);
+		free_chunks = prev;
+	}
+	n_free_chunks = 0;
 }
 
 void arena_pop_all(void)
@@ -33,50 +135,106 @@ void arena_pop_all(void)
 		}
 	} else {
 		while (cur_arena) {
-			struct arena *next = cur_arena->next;
-			mc_unregister_all_mem(cur_arena->m);
-			free(cur_arena);
-			cur_arena = next;
+			if (cur_arena->foreign)
+				mc_unregister_all_mem(cur_arena->foreign);
+			cur_arena = cur_arena->next;
 		}
+		n_arenas = 0;
+		cur_chunk = NULL;
 	}
+	free_chunks_all();
 }
 
 size_t arena_amount(void)
 {
-	size_t res = 0;
-
-	for (struct arena *cur = cur_arena; cur; cur = cur->next) {
-		res++;
-	}
-
-	return res;
+	return n_arenas;
 }
 
 void arena_pop(void)
 {
 	assert(cur_arena);
 
-	mc *m = cur_arena->m;
+	struct arena *a = cur_arena;
+
+	cur_arena = a->next;
+	n_arenas--;
+
+	if (a->foreign)
+		mc_free_all_mem(a->foreign);
+
+	while (a->large) {
+		struct large *next = a->large->next;
+		free(a->large);
+		a->large = next;
+	}
 
-	cur_arena = cur_arena->next;
-	// The old arena is saved in this `mc`
-	mc_free_all_mem(m);
+	// Everything after the mark belongs to the popped arena, including `a`
+	// itself, so `a` must not be used after this loop.
+	struct chunk *mark = a->chunk;
+	size_t used = a->used;
+	while (cur_chunk != mark) {
+		struct chunk *prev = cur_chunk->prev;
+		put_chunk(cur_chunk);
+		cur_chunk = prev;
+	}
+	if (cur_chunk)
+		cur_chunk->used = used;
 }
 
 void arena_register_mem(void *pt, const free_fun fun)
 {
 	assert(cur_arena);
-	mc_register_mem(cur_arena->m, pt, fun);
+	if (!cur_arena->foreign)
+		cur_arena->foreign = mc_init();
+	mc_register_mem(cur_arena->foreign, pt, fun);
 }
 
-void *arena_calloc(size_t nmemb, size_t member_size)
+void *arena_malloc(size_t nmemb, size_t member_size)
 {
 	assert(cur_arena);
-	return mc_calloc(cur_arena->m, nmemb, member_size);
+
+	if (nmemb == 0 || member_size == 0)
+		return NULL;
+
+	size_t size = nmemb * member_size;
+	if (size / nmemb != member_size)
+		return NULL;
+
+	arena_stats.allocs++;
+	arena_stats.bytes += size;
+	if (size <= LARGE_ALLOC)
+		return bump(size);
+
+	if (size > SIZE_MAX - LARGE_HEADER)
+		return NULL;
+	struct large *l = malloc(LARGE_HEADER + size);
+	if (NULL == l)
+		exit(EXIT_FAILURE);
+	arena_stats.mallocs++;
+	l->next = cur_arena->large;
+	cur_arena->large = l;
+	return (char *)l + LARGE_HEADER;
 }
 
-void *arena_malloc(size_t nmemb, size_t member_size)
+void *arena_calloc(size_t nmemb, size_t member_size)
 {
-	assert(cur_arena);
-	return mc_malloc(cur_arena->m, nmemb, member_size);
+	void *res = arena_malloc(nmemb, member_size);
+
+	if (res)
+		memset(res, 0, nmemb * member_size);
+	return res;
+}
+
+char *arena_strdup(const char *s)
+{
+	return arena_strndup(s, strlen(s));
+}
+
+char *arena_strndup(const char *s, size_t n)
+{
+	char *res = arena_malloc(n + 1, 1);
+
+	memcpy(res, s, n);
+	res[n] = '\0';
+	return res;
 }
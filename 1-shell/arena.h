@@ -7,10 +7,13 @@
 // variable exists and why it is important.
 extern int dealloc_on_pop_all;
 
-// Create a new memory arena.
+// Create a new memory arena. Arena's are regions: memory is handed out from
+// chunks with a bump pointer, and chunks are kept around for reuse after the
+// arena is popped, so pushing an arena does not need to call malloc.
 void arena_push(void);
 
-// Pop the current memory arena and free all memory in it.
+// Pop the current memory arena and free all memory in it. This does not depend
+// on the amount of allocations made in the arena.
 void arena_pop(void);
 
 // Pop all memory arena's. This function means that all memory allocated by
@@ -20,8 +23,21 @@ void arena_pop_all(void);
 // Get the amount of arena's.
 size_t arena_amount(void);
 
-// Register the memory given in `pt` in the current arena. It will be freed with
-// the function given by `fun` when the arena is popped.
+// Counters of the work done by the arena allocator since the shell started,
+// used by the bench builtin. `mallocs` counts the calls to malloc(3) for chunks
+// and large allocations: memory the arena could not hand out from what it
+// already had.
+struct arena_stats {
+	size_t pushes;
+	size_t allocs;
+	size_t bytes;
+	size_t mallocs;
+};
+extern struct arena_stats arena_stats;
+
+// Register the memory given in `pt`, which was not allocated by the arena
+// itself, in the current arena. It will be freed with the function given by
+// `fun` when the arena is popped.
 void arena_register_mem(void *pt, const free_fun fun);
 
 // Allocate a new piece of memory in the current arena. This function works the
@@ -30,7 +46,15 @@ void *arena_calloc(size_t nmemb, size_t member_size);
 
 // Allocate a new piece of memory in the current arena. This function works the
 // same as `malloc(3)`. It calculates the size needed by doing `nmemb *
-// member_size`, but is checks if the amount needed does not overflow.
+// member_size`, but is checks if the amount needed does not overflow. The
+// memory can not be freed on its own, only by popping the arena.
 void *arena_malloc(size_t nmemb, size_t member_size);
 
+// Copy the string `s` into the current arena, like `strdup(3)`.
+char *arena_strdup(const char *s);
+
+// Copy the first `n` bytes of `s` into the current arena and terminate them.
+// Unlike `strndup(3)`, `s` does not have to be terminated.
+char *arena_strndup(const char *s, size_t n);
+
 #endif /* ARENA_H */
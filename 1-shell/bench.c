@@ -0,0 +1,248 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the bench builtin, which measures what a command line costs when the shell
+ * runs it, in the style of hyperfine. The command line is run a number of times after a few warmup
+ * runs. For every run the wall-clock time, the user and system time of the shell and its children,
+ * the time the shell spent starting processes, and the work of the arena allocator are recorded,
+ * and the distribution of each is printed as percentiles.
+ */
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "arena.h"
+#include "front.h"
+#include "spawn.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS 100
+#define DEFAULT_WARMUP 5
+
+/* The measurements of a single run. */
+enum bench_metric { METRIC_WALL, METRIC_USER, METRIC_SYS, METRIC_START, N_METRICS };
+
+static const char *metric_names[N_METRICS] = {"wall", "user", "sys", "start"};
+
+/* A snapshot of the counters a run is measured with. */
+struct bench_point {
+    struct timespec wall;
+    double user;
+    double sys;
+    struct spawn_stats spawn;
+    struct arena_stats arena;
+};
+
+/* Convert a time value to seconds.
+ *
+ * tv: the time value
+ *
+ * Returns:
+ * the time in seconds
+ */
+static double seconds(struct timeval tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+/* Take a snapshot of the counters.
+ *
+ * point: where to store the snapshot
+ */
+static void take_point(struct bench_point *point) {
+    struct rusage self, children;
+
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    point->user = seconds(self.ru_utime) + seconds(children.ru_utime);
+    point->sys = seconds(self.ru_stime) + seconds(children.ru_stime);
+    point->spawn = spawn_stats;
+    point->arena = arena_stats;
+    clock_gettime(CLOCK_MONOTONIC, &point->wall);
+}
+
+/* Compare two doubles for qsort.
+ *
+ * a: the first double
+ * b: the second double
+ *
+ * Returns:
+ * a negative number, zero or a positive number if a is smaller than, equal to or larger than b
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Get a percentile of sorted samples, using the nearest rank.
+ *
+ * samples: the sorted samples
+ * n: the number of samples
+ * p: the percentile, 0 to 100
+ *
+ * Returns:
+ * the sample at the percentile
+ */
+static double percentile(const double *samples, size_t n, double p) {
+    size_t rank = (size_t)(p / 100 * n + 0.999999);
+    return samples[rank == 0 ? 0 : rank - 1];
+}
+
+/* Print the distribution of a metric in milliseconds.
+ *
+ * name: the name of the metric
+ * samples: the samples in seconds, sorted by this function
+ * n: the number of samples
+ */
+static void print_metric(const char *name, double *samples, size_t n) {
+    double sum = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+    qsort(samples, n, sizeof(double), compare_doubles);
+    printf("%-7s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, sum / n * 1e3, samples[0] * 1e3,
+           percentile(samples, n, 50) * 1e3, percentile(samples, n, 90) * 1e3,
+           percentile(samples, n, 99) * 1e3, samples[n - 1] * 1e3);
+}
+
+/* Parse a count given as an option.
+ *
+ * arg: the option argument
+ * min: the smallest allowed count
+ * count: where to store the count
+ *
+ * Returns:
+ * 0 on success, -1 if the argument is not a valid count
+ */
+static int parse_count(const char *arg, long min, long *count) {
+    char *end;
+
+    errno = 0;
+    *count = strtol(arg, &end, 10);
+    return errno != 0 || end == arg || *end != '\0' || *count < min || *count > INT_MAX ? -1 : 0;
+}
+
+/* Join words into a command line.
+ *
+ * argv: the words
+ * argc: the number of words
+ *
+ * Returns:
+ * the command line, separated by spaces, which the caller must free, or NULL on failure
+ */
+static char *join_words(char **argv, size_t argc) {
+    size_t len = 0;
+
+    for (size_t i = 0; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char *line = malloc(len);
+    if (line == NULL) {
+        return NULL;
+    }
+
+    char *p = line;
+    for (size_t i = 0; i < argc; i++) {
+        p = stpcpy(p, argv[i]);
+        *p++ = ' ';
+    }
+    p[-1] = '\0';
+    return line;
+}
+
+/* Run the command line once with its output discarded.
+ *
+ * line: the command line
+ * null_fd: an open file descriptor of /dev/null
+ */
+static void run_once(const char *line, int null_fd) {
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+
+    fflush(stdout);
+    dup2(null_fd, STDOUT_FILENO);
+    handle_command(line);
+    fflush(stdout);
+    if (saved != -1) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+int bench_command(size_t argc, char **argv) {
+    long runs = DEFAULT_RUNS, warmup = DEFAULT_WARMUP;
+    size_t first = 1;
+
+    for (; first + 1 < argc && argv[first][0] == '-'; first += 2) {
+        long *count = strcmp(argv[first], "-n") == 0   ? &runs
+                      : strcmp(argv[first], "-w") == 0 ? &warmup
+                                                       : NULL;
+        if (count == NULL || parse_count(argv[first + 1], count == &runs ? 1 : 0, count) == -1) {
+            break;
+        }
+    }
+    if (first >= argc || argv[first][0] == '-') {
+        fprintf(stderr, "Usage: bench [-n RUNS] [-w WARMUP] COMMAND...\n");
+        return 2;
+    }
+
+    char *line = join_words(argv + first, argc - first);
+    double *samples = malloc(N_METRICS * runs * sizeof(double));
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (line == NULL || samples == NULL || null_fd == -1) {
+        perror("bench");
+        free(line);
+        free(samples);
+        if (null_fd != -1) {
+            close(null_fd);
+        }
+        return 1;
+    }
+
+    for (long i = 0; i < warmup; i++) {
+        run_once(line, null_fd);
+    }
+
+    struct bench_point before, after;
+    unsigned long processes = 0;
+    size_t pushes = 0, allocs = 0, bytes = 0, mallocs = 0;
+
+    for (long i = 0; i < runs; i++) {
+        take_point(&before);
+        run_once(line, null_fd);
+        take_point(&after);
+
+        samples[METRIC_WALL * runs + i] = (after.wall.tv_sec - before.wall.tv_sec) +
+                                          (after.wall.tv_nsec - before.wall.tv_nsec) / 1e9;
+        samples[METRIC_USER * runs + i] = after.user - before.user;
+        samples[METRIC_SYS * runs + i] = after.sys - before.sys;
+        samples[METRIC_START * runs + i] = (after.spawn.ns - before.spawn.ns) / 1e9;
+        processes += after.spawn.processes - before.spawn.processes;
+        pushes += after.arena.pushes - before.arena.pushes;
+        allocs += after.arena.allocs - before.arena.allocs;
+        bytes += after.arena.bytes - before.arena.bytes;
+        mallocs += after.arena.mallocs - before.arena.mallocs;
+    }
+
+    printf("bench: %ld runs of \"%s\" after %ld warmup runs\n", runs, line, warmup);
+    printf("%-7s %9s %9s %9s %9s %9s %9s\n", "ms", "mean", "min", "p50", "p90", "p99", "max");
+    for (int m = 0; m < N_METRICS; m++) {
+        print_metric(metric_names[m], samples + m * runs, runs);
+    }
+    printf("per run: %.2f processes started, %.1f arena pushes, %.1f arena allocations "
+           "(%.0f bytes), %.2f arena mallocs\n",
+           (double)processes / runs, (double)pushes / runs, (double)allocs / runs,
+           (double)bytes / runs, (double)mallocs / runs);
+
+    close(null_fd);
+    free(samples);
+    free(line);
+    return 0;
+}
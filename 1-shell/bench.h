@@ -0,0 +1,18 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+/*
+ * The bench builtin: "bench [-n RUNS] [-w WARMUP] COMMAND...". The words of
+ * COMMAND are joined into a command line, which is run WARMUP times and then
+ * RUNS times while it is measured, with its standard output discarded. The
+ * distribution of the wall-clock, user, system and process start times is
+ * printed, followed by the processes started and the arena allocations per
+ * run.
+ *
+ * Returns the exit status of the builtin.
+ */
+int bench_command(size_t argc, char **argv);
+
+#endif
@@ -0,0 +1,52 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains a counting allocator, loaded into the shell with LD_PRELOAD. It counts every
+ * call to malloc, calloc and realloc in the shell process and prints the total when the shell
+ * exits. Running a script of 10 commands and one of 10000 commands then shows whether running a
+ * command allocates: if it does not, both counts are the same. Processes the shell starts do not
+ * load it, as LD_PRELOAD is removed from the environment before the shell reads it.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// The allocator of glibc itself, which the functions below pass the calls on to.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocations = 0;
+static pid_t shell_pid;
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+__attribute__((constructor)) static void start(void) {
+    shell_pid = getpid();
+    unsetenv("LD_PRELOAD");
+}
+
+// Forked children that exit do not report, only the shell itself does.
+__attribute__((destructor)) static void report(void) {
+    if (getpid() == shell_pid) {
+        fprintf(stderr, "allocations: %lu\n", allocations);
+    }
+}
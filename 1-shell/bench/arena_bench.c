@@ -0,0 +1,137 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains a benchmark of the arena allocator. It simulates the way the shell uses
+ * arena's: an arena is pushed for every command, a number of small allocations are made in it, and
+ * the arena is popped again. The same workload is run on the region allocator behind the arena_*
+ * functions and on a plain mc per arena (the way arena's used to be implemented). Every variant runs
+ * in its own child process, so the peak RSS reported for it is its own.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "../arena.h"
+#include "../mc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+
+// The amount of nested arena's per command, like nested calls to run_command.
+const int DEPTH = 3;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run the workload on the arena_* functions.
+ *
+ * commands: the number of commands to simulate
+ * allocs: the number of allocations per arena
+ */
+static void run_arena(long commands, long allocs) {
+    unsigned int seed = 42;
+
+    for (long i = 0; i < commands; i++) {
+        for (int d = 0; d < DEPTH; d++) {
+            arena_push();
+            for (long j = 0; j < allocs; j++) {
+                char *pt = arena_malloc(1, 16 + rand_r(&seed) % 112);
+                pt[0] = 1;
+            }
+        }
+        for (int d = 0; d < DEPTH; d++) {
+            arena_pop();
+        }
+    }
+}
+
+/* Run the workload on a stack of mc's, the way arena's used to be implemented.
+ *
+ * commands: the number of commands to simulate
+ * allocs: the number of allocations per arena
+ */
+static void run_mc(long commands, long allocs) {
+    unsigned int seed = 42;
+    mc *stack[DEPTH];
+
+    for (long i = 0; i < commands; i++) {
+        for (int d = 0; d < DEPTH; d++) {
+            stack[d] = mc_init();
+            mc_calloc(stack[d], 1, 2 * sizeof(void *));
+            for (long j = 0; j < allocs; j++) {
+                char *pt = mc_malloc(stack[d], 1, 16 + rand_r(&seed) % 112);
+                pt[0] = 1;
+            }
+        }
+        for (int d = DEPTH - 1; d >= 0; d--) {
+            mc_free_all_mem(stack[d]);
+        }
+    }
+}
+
+/* Run a variant in a child process and print its results.
+ *
+ * name: the name of the variant
+ * run: the function running the workload
+ * commands: the number of commands to simulate
+ * allocs: the number of allocations per arena
+ */
+static void measure(const char *name, void (*run)(long, long), long commands, long allocs) {
+    int fds[2];
+    double elapsed;
+    struct rusage usage;
+    int status;
+
+    fflush(stdout);
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        double start = now();
+        run(commands, allocs);
+        elapsed = now() - start;
+        if (write(fds[1], &elapsed, sizeof(elapsed)) != sizeof(elapsed)) {
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed)) {
+        fprintf(stderr, "%s: benchmark failed\n", name);
+        exit(EXIT_FAILURE);
+    }
+    close(fds[0]);
+    wait4(pid, &status, 0, &usage);
+
+    double total = (double)commands * DEPTH * allocs;
+    printf("%-9s | %13.0f | %8.3f | %14ld\n", name, total / elapsed, elapsed, usage.ru_maxrss);
+}
+
+int main(int argc, char *argv[]) {
+    long commands = argc > 1 ? atol(argv[1]) : 2000;
+    long allocs = argc > 2 ? atol(argv[2]) : 4096;
+
+    printf("%ld commands, %d arena's per command, %ld allocations per arena\n", commands, DEPTH,
+           allocs);
+    printf("Allocator | Allocations/s | Time (s) | Peak RSS (KiB)\n");
+    printf("-------------------------------------------------------\n");
+    measure("region", run_arena, commands, allocs);
+    measure("mc", run_mc, commands, allocs);
+
+    return 0;
+}
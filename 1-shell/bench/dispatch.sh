@@ -0,0 +1,8 @@
+true
+cd .
+true && cd . || false
+true | true
+echo $HOME
+(true)
+>/dev/null echo hi
+echo "quoted $HOME" 'single $HOME' \x41\$ a\ b
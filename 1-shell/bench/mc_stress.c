@@ -0,0 +1,112 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains a stress test of the memory context (mc). It registers up to a million
+ * pointers, unregisters them in random order and frees them, and prints the time per operation for
+ * growing amounts of pointers. When every operation is O(1), the time per operation stays flat as
+ * the amount grows; with a linear scan it grows with the amount. The test is built without NDEBUG,
+ * so the duplicate pointer check of debug builds is included in the timings.
+ *
+ * The test is also built against the old list of mc_list.c as mc_stress_list. Both print a checksum
+ * of the pointers that were freed, in the order they were freed, which must be the same.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "../mc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static long freed = 0;
+static unsigned long checksum;
+static char *base;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void count_free(void *pt) {
+    checksum = checksum * 1000003 + ((char *)pt - base);
+    freed++;
+}
+
+/* Stress the mc with `n` pointers and print the time per operation.
+ *
+ * n: the amount of pointers to register
+ */
+static void stress(long n) {
+    base = malloc(n);
+    long *order = malloc(n * sizeof(long));
+    unsigned int seed = 42;
+    double start, reg, unreg, free_one, free_all;
+
+    if (base == NULL || order == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Unregister in random order, so no implementation gets lucky with the order of its list.
+    for (long i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (long i = n - 1; i > 0; i--) {
+        long j = rand_r(&seed) % (i + 1);
+        long tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    checksum = 0;
+    mc *m = mc_init();
+    start = now();
+    for (long i = 0; i < n; i++) {
+        mc_register_mem(m, base + i, count_free);
+    }
+    reg = now() - start;
+
+    start = now();
+    for (long i = 0; i < n; i++) {
+        free(mc_unregister_mem(m, base + order[i]));
+    }
+    unreg = now() - start;
+
+    for (long i = 0; i < n; i++) {
+        mc_register_mem(m, base + i, count_free);
+    }
+    start = now();
+    for (long i = 0; i < n / 2; i++) {
+        mc_free_mem(m, base + order[i]);
+    }
+    free_one = now() - start;
+
+    start = now();
+    mc_free_all_mem(m);
+    free_all = now() - start;
+
+    assert(freed == n);
+    freed = 0;
+
+    printf("%9ld | %11.1f | %13.1f | %11.1f | %11.1f | %016lx\n", n, reg / n * 1e9, unreg / n * 1e9,
+           free_one / (n / 2) * 1e9, free_all / (n - n / 2) * 1e9, checksum);
+
+    free(order);
+    free(base);
+}
+
+int main(int argc, char *argv[]) {
+    long max = argc > 1 ? atol(argv[1]) : 1000000;
+
+    printf("Pointers  | register ns | unregister ns | free one ns | free all ns | checksum\n");
+    printf("-------------------------------------------------------------------------------------\n");
+    for (long n = 1000; n <= max; n *= 10) {
+        stress(n);
+    }
+
+    return 0;
+}
@@ -8,6 +8,7 @@ import shutil
 import signal
 import subprocess
 import sys
+import tempfile
 import time
 import pexpect
 
@@ -147,6 +148,10 @@ def run(writer=None):
                   Test("Simple", bash_cmp("pwd"), valgrind=False),
                   Test("Arguments", bash_cmp("ls -alh /bin")),
                   Test("Wait for 1 proc", test_wait_basic),
+                  Test("Script without #!", bash_cmp(">a echo echo script; chmod +x a; ./a; ./a | cat")),
+                  Test("Quoting", manual_cmp("echo \"a  b\" c\\x41\\ d\necho \"\\tq\" \\x41\"b\"c plain",
+                                             out="a  b cA d\n\tq Abc plain\n", err=""),
+                       valgrind=True),
                   stop_if_fail=True),
         TestGroup("exit builtin", 1.0,
                   Test("exit", test_exit),
@@ -189,6 +194,28 @@ def run(writer=None):
         TestGroup("Redirections", 1.0,
                   Test("To/from file", bash_cmp(">a ls /bin; <a wc -l")),
                   Test("Overwrite", bash_cmp(">a ls /bin; >a ls; cat a")),
+                  Test("Builtin", bash_cmp(">/dev/null cd /; pwd")),
+                  Test("Free descriptor", bash_cmp("3>a true; 4>a ls /proc/self/fd; ls /proc/self/fd")),
+                  ),
+        TestGroup("Here-documents", 0.5,
+                  Test("Here-document", bash_cmp("<<EOF cat\nhello\n  world\n\nEOF\necho done")),
+                  Test("Pipeline", bash_cmp("<<A cat | <<<b cat\na\nA\n<<B wc -l\n1\n2\nB")),
+                  Test("Here-string", bash_cmp("<<<\"here string\" tr a-z A-Z")),
+                  Test("Large", bash_cmp("<<EOF wc -c\n" + "x" * 100000 + "\nEOF")),
+                  ),
+        TestGroup("Process substitution", 0.5,
+                  Test("Input", bash_cmp("diff <(echo a; echo b) <(echo a; echo c); echo $?")),
+                  Test("Output", bash_cmp("echo hi | tee >(>a tr a-z A-Z) | wc -l; sleep 0.2; cat a")),
+                  Test("No leaks", bash_cmp("cat <(true) <(true); ls /proc/self/fd")),
+                  Test("With time", manual_cmp("2>/dev/null { time -p cat <(echo a) <(echo b); }",
+                                               out="a\nb\n", err="")),
+                  ),
+        TestGroup("Bench builtin", 0.5,
+                  Test("Report", manual_cmp(">a bench -n 5 -w 1 echo hi; <a grep -c -e ^wall -e ^start; "
+                                            "<a grep -o \"1.00 processes\"",
+                                            out="2\n1.00 processes\n", err="")),
+                  Test("Usage", manual_cmp("bench -n 0 true", err="Usage: bench [-n RUNS] [-w WARMUP] "
+                                           "COMMAND...\n", rv=2)),
                   ),
         TestGroup("Detached commands", 0.5,
                   Test("sleep", test_detach),
@@ -196,10 +223,104 @@ def run(writer=None):
         TestGroup("Subshells", 0.5,
                   Test("exit", bash_cmp("(pwd; exit 2); exit 1")),
                   Test("cd", bash_cmp("cd /bin; pwd; (cd /; pwd); pwd")),
+                  Test("Without fork", bash_cmp("(echo a | tr a b; false) || (ls /; echo c)")),
+                  Test("Variables", bash_cmp("X=a; (X=b; echo $X); echo $X")),
                   ),
         TestGroup("Environment variables", 0.5,
                   Test("Simple", manual_cmp("set hello=world; env | grep hello",
                                             out="hello=world\n", err="")),
+                  Test("Expansion", manual_cmp("X=a; echo $X ${X}b $UNSET.",
+                                               out="a ab .\n", err="")),
+                  Test("Redirects", manual_cmp("X=a; >$X echo hi; >>${X} echo $X; <$X cat; "
+                                               "<<<\"$X $?\" cat", out="hi\na\na 0\n", err="")),
+                  Test("Single quotes", bash_cmp("X=a; echo '$HOME' '$X'b '${X}' x'$?'")),
+                  Test("Escaped", bash_cmp("X=a; echo \\$HOME \\$X$X \"\\$X\"; >\\$X echo hi; <'$X' cat; "
+                                           "rm '$X'")),
+                  Test("Export", manual_cmp("X=1; env | grep -c ^X=; export X; env | grep -c ^X=",
+                                            out="0\n1\n", err="")),
+                  ),
+        TestGroup("Exit status", 0.5,
+                  Test("$?", bash_cmp("false; echo $?; true; echo $?")),
+                  Test("Pipeline and subshell", bash_cmp("true | false; echo $?; (exit 3); echo $?")),
+                  Test("And/or", bash_cmp("true && echo a || echo b; false && echo c || echo d")),
+                  Test("Stop early", bash_cmp("false && echo a && echo b; echo $?")),
+                  Test("Shell exit status", bash_cmp("true; false")),
+                  ),
+        TestGroup("Command hash", 0.5,
+                  Test("Hits", manual_cmp("set PATH=/bin; >/dev/null ls; >/dev/null ls; hash",
+                                          out="hits\tcommand\n   2\t/bin/ls\n"
+                                              "hash: 1 hits, 1 misses\n", err="")),
+                  Test("Clear on PATH change",
+                       manual_cmp(">/dev/null ls; set PATH=/bin; hash",
+                                  out="hash: hash table empty\nhash: 0 hits, 1 misses\n",
+                                  err="")),
+                  ),
+        TestGroup("Plan cache", 0.5,
+                  Test("Hits", manual_cmp("echo a\necho a\nplans | head -n 1",
+                                          out="a\na\nplans: 2 cached, 1 hits, 2 misses "
+                                              "(33.3% hit rate)\n", err="")),
+                  Test("Clear", manual_cmp("echo a\nplans -r\necho a\nplans | head -n 1",
+                                           out="a\na\nplans: 2 cached, 0 hits, 4 misses "
+                                               "(0.0% hit rate)\n", err="")),
+                  ),
+        TestGroup("Jobs", 0.5,
+                  Test("Wait", manual_cmp("sleep 0.2 &\nwait; echo done; jobs",
+                                          out="done\n", err="")),
+                  Test("In a pipeline", manual_cmp("sleep 0.2 &\njobs | cat; wait",
+                                                   out="[1]+  Running                 sleep 0.2 &\n",
+                                                   err="")),
+                  Test("In a substitution", manual_cmp("sleep 0.2 &\necho | cat <(jobs); wait",
+                                                       out="[1]+  Running                 sleep 0.2 &\n",
+                                                       err="")),
+                  Test("Reaped", manual_cmp("sleep 0.1 & sleep 0.1 & sleep 0.3; "
+                                            ">a ps -eo stat=,comm=; <a grep -c \"^Z.*42sh\"",
+                                            out="0\n", err="")),
+                  ),
+        TestGroup("Relay builtin", 0.5,
+                  Test("Pipeline", manual_cmp("head -c 1000000 /dev/zero | relay | wc -c",
+                                              out="1000000\n", err="")),
+                  Test("Broken pipe", manual_cmp("yes | relay | head -n 2; echo $?",
+                                                 out="y\ny\n0\n", err="")),
+                  Test("No-op stage", manual_cmp("set x=1 | relay; env | grep -c ^x=",
+                                                 out="0\n", err="")),
+                  ),
+        TestGroup("Pipe size", 0.5,
+                  Test("PIPESIZE", manual_cmp("set PIPESIZE=256k; python3 -c \"import fcntl; "
+                                              "print(fcntl.fcntl(1, 1032))\" | cat",
+                                              out="262144\n", err="")),
+                  Test("Reported once", manual_cmp("set PIPESIZE=x; true | true; true | true",
+                                                   out="", err="PIPESIZE: invalid size: x\n")),
+                  ),
+        TestGroup("Resource usage", 0.5,
+                  Test("time", manual_cmp("2>a { time true | true; }; "
+                                          "<a grep -c -e \"^time: pid\" -e ^real",
+                                          out="3\n", err="")),
+                  Test("Pipeline", manual_cmp("2>a { time echo hi | tr a-z A-Z | wc -c; }; "
+                                              "<a grep -c \"^time: pid.*: tr a-z A-Z$\"",
+                                              out="3\n1\n", err="")),
+                  Test("time -p", manual_cmp("2>a { time -p echo hi | wc -l; }; <a cut -d \" \" -f 1",
+                                             out="1\nreal\nuser\nsys\n", err="")),
+                  Test("Accounting", manual_cmp("set ACCOUNTING=a; >a true; <a cut -f 2,9",
+                                                out="0\ttrue\n", err="")),
+                  ),
+        TestGroup("Trace", 0.5,
+                  Test("Records", manual_cmp("2>a ./42sh -t 2 -c \"true | true\"; <a grep -c type",
+                                             out="3\n", err="")),
+                  Test("Process times", manual_cmp("2>a ./42sh -t 2 -c true; <a grep -o -e spawn -e waited",
+                                                   out="spawn\nwaited\n", err="")),
+                  ),
+        TestGroup("Parallel groups", 0.5,
+                  Test("Concurrent", manual_cmp("set PARALLEL=2; { sleep 0.3; echo a ;; echo b }",
+                                                out="b\na\n", err="")),
+                  Test("Limit", manual_cmp("set PARALLEL=1; { sleep 0.3; echo a ;; echo b }",
+                                           out="a\nb\n", err="")),
+                  Test("Status", manual_cmp("{ true ;; false ;; exit 3 }; echo $?",
+                                            out="1\n", err="")),
+                  ),
+        TestGroup("History", 0.5,
+                  Test("Previous line", test_history("\x10\r")),
+                  Test("Search", test_history("\x12previous\r")),
+                  Test("Argument", test_history("echo \x1b\x19\r")),
                   ),
         TestGroup("Prompt", 0.5,
                   Test("Username", test_prompt("u=\\u $")),
@@ -210,6 +331,8 @@ def run(writer=None):
         TestGroup("Job control", 2.0,
                   Test("Ctrl-z", test_ctrl_z),
                   Test("Ctrl-z + bg + fg", test_bg_fg),
+                  Test("Detach + fg", test_detach_fg),
+                  Test("Ctrl-z after fg", test_advanced_jobs),
                   ),
     ]
 
@@ -412,6 +535,31 @@ def test_prompt(prompt):
     return test_prompt_inner
 
 
+def test_history(keys):
+    def test_history_inner():
+        global last_command
+        last_command = repr(keys)
+
+        # The history of a previous session, which is only read once a line is recalled.
+        home = tempfile.mkdtemp()
+        try:
+            with open(os.path.join(home, ".history"), "w") as f:
+                f.write("echo previous-session\n")
+            p = pexpect.spawn(STUDENT_SHELL, env={"HOME": home, "PATH": os.environ["PATH"]})
+            p.expect("\\$ ")
+            p.send(keys)
+            try:
+                p.expect("\r\nprevious-session\r\n", timeout=2)
+            except pexpect.TIMEOUT:
+                raise TestError("Line of a previous session not recalled with %s, got \"%s\"" %
+                                (repr(keys), p.before.decode("UTF-8")))
+            p.sendline("exit")
+        finally:
+            shutil.rmtree(home)
+
+    return test_history_inner
+
+
 def test_detach():
     global last_command
     last_command = "sleep 1 &"
@@ -0,0 +1,218 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the command hash of the shell: a cache that maps program names to the path of
+ * their executable. Without it every command walks $PATH and tries to execute the program in each
+ * directory, like execvp() does. With it $PATH is only searched the first time a program is used.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "command_hash.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The number of buckets in the hash table. Scripts use few distinct programs, so this is plenty.
+#define COMMAND_HASH_SIZE 64
+
+// The search path used when $PATH is not set.
+const char *DEFAULT_PATH = "/bin:/usr/bin";
+
+/* A cached program, stored in a singly linked list per bucket. */
+struct command_entry {
+    struct command_entry *next;
+    char *name;
+    char *path;
+    unsigned long hits;
+};
+
+static struct command_entry *table[COMMAND_HASH_SIZE];
+static unsigned long total_hits = 0;
+static unsigned long total_misses = 0;
+
+/* Compute the bucket of a program name using the djb2 string hash.
+ *
+ * name: the program name
+ *
+ * Returns:
+ * the index of the bucket
+ */
+static size_t bucket_of(const char *name) {
+    unsigned long hash = 5381;
+
+    for (const char *c = name; *c != '\0'; c++) {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+
+    return hash % COMMAND_HASH_SIZE;
+}
+
+/* Check whether a path refers to an executable regular file.
+ *
+ * path: the path to check
+ *
+ * Returns:
+ * 1 if the file can be executed, 0 otherwise
+ */
+static int is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/* Search $PATH for a program.
+ *
+ * name: the program name, without slashes
+ *
+ * Returns:
+ * the path of the program in newly allocated memory, or NULL if it was not found
+ */
+static char *search_path(const char *name) {
+    const char *dirs = var_get("PATH");
+    size_t name_len = strlen(name);
+
+    if (dirs == NULL) {
+        dirs = DEFAULT_PATH;
+    }
+
+    while (1) {
+        const char *end = strchr(dirs, ':');
+        size_t dir_len = end ? (size_t)(end - dirs) : strlen(dirs);
+
+        // An empty entry in $PATH means the current directory.
+        char *path = malloc(dir_len + name_len + 3);
+        if (path == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        if (dir_len == 0) {
+            strcpy(path, ".");
+            dir_len = 1;
+        } else {
+            memcpy(path, dirs, dir_len);
+        }
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+
+        if (is_executable(path)) {
+            return path;
+        }
+        free(path);
+
+        if (end == NULL) {
+            return NULL;
+        }
+        dirs = end + 1;
+    }
+}
+
+/* Resolve a program name to the path of its executable.
+ *
+ * program: the program name
+ *
+ * Returns:
+ * the path of the program, or NULL if it was not found
+ */
+const char *command_hash_lookup(const char *program) {
+    if (strchr(program, '/') != NULL) {
+        return program;
+    }
+    if (program[0] == '\0') {
+        return NULL;
+    }
+
+    size_t bucket = bucket_of(program);
+    for (struct command_entry *e = table[bucket]; e != NULL; e = e->next) {
+        if (strcmp(e->name, program) == 0) {
+            e->hits++;
+            total_hits++;
+            return e->path;
+        }
+    }
+
+    total_misses++;
+    char *path = search_path(program);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    struct command_entry *e = malloc(sizeof(struct command_entry));
+    char *name = strdup(program);
+    if (e == NULL || name == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    e->name = name;
+    e->path = path;
+    e->hits = 1;
+    e->next = table[bucket];
+    table[bucket] = e;
+
+    return e->path;
+}
+
+/* Free a cache entry.
+ *
+ * e: the entry to free
+ */
+static void free_entry(struct command_entry *e) {
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+/* Remove a program from the cache.
+ *
+ * program: the program name
+ */
+void command_hash_forget(const char *program) {
+    struct command_entry **link = &table[bucket_of(program)];
+
+    while (*link != NULL) {
+        if (strcmp((*link)->name, program) == 0) {
+            struct command_entry *e = *link;
+            *link = e->next;
+            free_entry(e);
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/* Remove all programs from the cache. The hit/miss counters are kept. */
+void command_hash_clear(void) {
+    for (size_t i = 0; i < COMMAND_HASH_SIZE; i++) {
+        struct command_entry *e = table[i];
+        while (e != NULL) {
+            struct command_entry *next = e->next;
+            free_entry(e);
+            e = next;
+        }
+        table[i] = NULL;
+    }
+}
+
+/* Print the cache contents and counters, in the same format as the hash builtin of bash. */
+void command_hash_print(void) {
+    int empty = 1;
+
+    for (size_t i = 0; i < COMMAND_HASH_SIZE; i++) {
+        for (struct command_entry *e = table[i]; e != NULL; e = e->next) {
+            if (empty) {
+                printf("hits\tcommand\n");
+                empty = 0;
+            }
+            printf("%4lu\t%s\n", e->hits, e->path);
+        }
+    }
+
+    if (empty) {
+        printf("hash: hash table empty\n");
+    }
+    printf("hash: %lu hits, %lu misses\n", total_hits, total_misses);
+}
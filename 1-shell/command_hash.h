@@ -0,0 +1,30 @@
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+/*
+ * Resolve the program name `program` to the path of an executable, the way
+ * execvp(3) would. Names containing a slash are returned as is. Results of
+ * the $PATH search are cached, so each program is only searched for once.
+ *
+ * Returns the path, or NULL if the program could not be found. The returned
+ * string is owned by the cache and is only valid until it is cleared.
+ */
+const char *command_hash_lookup(const char *program);
+
+/*
+ * Remove a single program from the cache, e.g. because its cached path no
+ * longer exists.
+ */
+void command_hash_forget(const char *program);
+
+/*
+ * Remove all programs from the cache. Must be called whenever $PATH changes.
+ */
+void command_hash_clear(void);
+
+/*
+ * Print the cached programs and the hit/miss counters on the standard output.
+ */
+void command_hash_print(void);
+
+#endif
@@ -2,32 +2,56 @@
 #include "parser/parser.h"
 #include "parser/lexer.h"
 #include "parser/lex.yy.h"
+#include "parser/ast.h"
 #include "shell.h"
+#include "front.h"
 #include "arena.h"
+#include "plan_cache.h"
+#include "jobs.h"
+#include "spawn.h"
+#include "trace.h"
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
 char *prompt = NULL;
-extern int echo, parse_error; /* From the parser */
+extern int echo, noexec, parse_error; /* From the parser */
+extern node_t *parse_result;
 
-static void handle_command(char *cmd)
+/* The parser is reset after every line, so one parser is used for all lines */
+static void *parser = NULL;
+
+static void free_parser(void)
+{
+	ParseFree(parser, free);
+}
+
+/*
+ * Lex and parse the `len` bytes of `line`. The line is scanned in place, so
+ * both line[len] and line[len + 1] must be 0. The tree is allocated in the
+ * current arena. Returns NULL for an empty line or a syntax error.
+ */
+static node_t *parse_line(char *line, size_t len)
 {
-	void *parser;
 	int yv;
 	struct lex_token tok;
-	YY_BUFFER_STATE st;
 
-	/* Prepare a parser context */
-	parser = ParseAlloc(malloc);
+	/* Prepare the parser context */
+	if (!parser) {
+		parser = ParseAlloc(malloc);
+		atexit(&free_parser);
+	}
 	parse_error = 0;
+	parse_result = NULL;
 
-	/* Prepare a lexer context */
-	st = yy_scan_string(cmd);
+	/* Prepare the lexer context */
+	lexer_scan_line(line, len);
 
 	/* While there are some lexing tokens... */
 	while ((yv = yylex()) != 0) {
@@ -36,7 +60,7 @@ static void handle_command(char *cmd)
 
 		/* NUMBER and WORD are the only 2 token types with a carried value. */
 		if (yv == NUMBER || yv == WORD) {
-			tok.text = strdup(token_text);
+			tok.text = arena_strndup(token_text, token_len);
 			if (yv == NUMBER)
 				tok.number = atoi(tok.text);
 		}
@@ -49,11 +73,360 @@ static void handle_command(char *cmd)
 			break;
 	}
 
-	/* Complete parse */
+	/* Complete parse, this also resets the parser for the next line */
 	Parse(parser, 0, tok);
 
-	ParseFree(parser, free);
-	yy_delete_buffer(st);
+	if (parse_error) {
+		last_status = 2;
+		return NULL;
+	}
+	return parse_result;
+}
+
+static void run_tree(node_t *root)
+{
+	if (echo)
+		print_tree_flat(root, 1);
+	if (!noexec) {
+		plan_cache_begin();
+		run_command(root);
+		plan_cache_end();
+	}
+}
+
+/*
+ * Here-documents. A command line with here-documents is parsed, but it only
+ * runs after the lines that follow it have been read as their bodies. Until
+ * then its arena stays pushed, and the body that is being read grows in a
+ * buffer of its own.
+ */
+static node_t *heredoc_root = NULL;
+static node_t *heredoc = NULL;
+static size_t n_heredocs = 0;
+static char *heredoc_body = NULL;
+static size_t heredoc_len = 0, heredoc_size = 0;
+
+/* Start reading the body of the next here-document of the waiting line */
+static void next_heredoc(void)
+{
+	heredoc = find_heredoc(heredoc_root, n_heredocs++);
+	heredoc_len = 0;
+	if (!heredoc) {
+		run_tree(heredoc_root);
+		heredoc_root = NULL;
+		n_heredocs = 0;
+		arena_pop();
+	}
+}
+
+/* Store the body read so far in the here-document, and go on to the next */
+static void end_heredoc(void)
+{
+	char *body = arena_malloc(heredoc_len + 1, 1);
+
+	if (heredoc_len > 0)
+		memcpy(body, heredoc_body, heredoc_len);
+	body[heredoc_len] = '\0';
+	heredoc->redirect.target = body;
+	next_heredoc();
+}
+
+/* Add a line to the body of the here-document, or end it at its delimiter */
+static void read_heredoc(const char *line, size_t len)
+{
+	if (len == strlen(heredoc->redirect.target) &&
+	    memcmp(line, heredoc->redirect.target, len) == 0) {
+		end_heredoc();
+		return;
+	}
+
+	if (heredoc_len + len + 1 > heredoc_size) {
+		while (heredoc_len + len + 1 > heredoc_size)
+			heredoc_size = heredoc_size ? 2 * heredoc_size : 256;
+		heredoc_body = realloc(heredoc_body, heredoc_size);
+		if (!heredoc_body) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(heredoc_body + heredoc_len, line, len);
+	heredoc_body[heredoc_len + len] = '\n';
+	heredoc_len += len + 1;
+}
+
+/*
+ * Called at the end of the input: like bash, here-documents that are still
+ * being read end there, and the waiting line runs.
+ */
+static void finish_input(void)
+{
+	while (heredoc_root) {
+		fprintf(stderr, "mysh: here-document delimited by end-of-file (wanted `%s')\n",
+			heredoc->redirect.target);
+		end_heredoc();
+	}
+	free(heredoc_body);
+	heredoc_body = NULL;
+	heredoc_size = 0;
+}
+
+/*
+ * Parse and run the `len` bytes of `line`, see parse_line(). Lines that were
+ * seen before are run from the plan cache without parsing them again. With
+ * -n the cache is not used, so only the parser is measured.
+ */
+static void handle_line(char *line, size_t len)
+{
+	struct timespec start, end;
+	node_t *root;
+
+	if (heredoc_root) {
+		read_heredoc(line, len);
+		return;
+	}
+
+	/* Forget about background jobs that have finished since the last line */
+	jobs_notify();
+
+	if (!noexec && (root = plan_cache_lookup(line, len))) {
+		run_tree(root);
+		return;
+	}
+
+	/* All memory for this line (tokens, AST) comes from its own arena */
+	arena_push();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	root = parse_line(line, len);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* The bodies of here-documents differ every time, so such lines are
+	 * not cached */
+	if (root && find_heredoc(root, 0)) {
+		heredoc_root = root;
+		next_heredoc();
+		return;
+	}
+
+	if (root) {
+		if (!noexec)
+			root = plan_cache_insert(line, len, root,
+						 (end.tv_sec - start.tv_sec) * 1000000000L +
+						 (end.tv_nsec - start.tv_nsec));
+		run_tree(root);
+	}
+
+	arena_pop();
+}
+
+/*
+ * Handle all complete lines in the `len` bytes of `buf`. The lexer needs two
+ * 0's after a line: the newline is replaced by one, and the first byte of the
+ * next line is replaced for as long as the line is handled. `buf` must have
+ * room for one byte after `len`. Returns the offset of the incomplete last
+ * line.
+ */
+static size_t handle_lines(char *buf, size_t len)
+{
+	size_t start = 0;
+	char *nl;
+
+	while ((nl = memchr(buf + start, '\n', len - start))) {
+		size_t end = nl - buf;
+		char next = buf[end + 1];
+
+		buf[end] = '\0';
+		buf[end + 1] = '\0';
+		handle_line(buf + start, end - start);
+		buf[end + 1] = next;
+		start = end + 1;
+	}
+
+	return start;
+}
+
+/* Like bash, run every line of a -c command separately */
+void handle_command(const char *cmd)
+{
+	size_t len = strlen(cmd), start;
+	char *line = malloc(len + 2);
+
+	if (!line) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(line, cmd, len + 1);
+	line[len + 1] = '\0';
+	start = handle_lines(line, len);
+	if (start < len)
+		handle_line(line + start, len - start);
+	finish_input();
+	free(line);
+}
+
+/* The amount of bytes read from a script at once */
+#define SCRIPT_BLOCK 65536
+
+/*
+ * Run the commands in the script `fd`. The script is read in large blocks and
+ * split into lines here, which is much cheaper than going through readline for
+ * every line. Lines are handled in place in the block.
+ */
+static void run_script(int fd)
+{
+	size_t size = SCRIPT_BLOCK, len = 0, start;
+	char *buf;
+	ssize_t n;
+
+	/* Two spare bytes, so there is room for the terminating 0's of the
+	 * lexer even when the last line fills the buffer */
+	buf = malloc(size + 2);
+	if (!buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	while (1) {
+		/* A line that does not fit in the buffer: make it larger */
+		if (len == size) {
+			size *= 2;
+			buf = realloc(buf, size + 2);
+			if (!buf) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		n = read(fd, buf + len, size - len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("read");
+			break;
+		}
+		if (n == 0)
+			break;
+		len += n;
+
+		start = handle_lines(buf, len);
+
+		/* Keep the incomplete last line for the next block */
+		memmove(buf, buf + start, len - start);
+		len -= start;
+	}
+
+	/* The last line does not need to end with a newline */
+	if (len > 0) {
+		buf[len] = '\0';
+		buf[len + 1] = '\0';
+		handle_line(buf, len);
+	}
+	finish_input();
+
+	free(buf);
+}
+
+/*
+ * History. Every line is appended to the history file as soon as it is
+ * entered, instead of rewriting the whole file. The file is only read when
+ * the history is recalled for the first time, so a shell that is started for
+ * a few commands does not pay for a large history file.
+ */
+static int history_loaded = 0;
+static int history_saved = 1; /* All lines of this session are in the file */
+
+static void load_history(void)
+{
+	if (history_loaded)
+		return;
+	history_loaded = 1;
+
+	/* The lines of this session were appended to the file, so the file
+	 * has them too, in the right order */
+	if (history_saved)
+		clear_history();
+	read_history(NULL);
+	using_history();
+}
+
+static void save_history(const char *line)
+{
+	add_history(line);
+	/* Appending fails if there is no history file yet */
+	if (append_history(1, NULL) != 0 && write_history(NULL) != 0)
+		history_saved = 0;
+}
+
+/*
+ * The readline commands that read the history. Every one of them gets a lazy
+ * version that loads the history file first.
+ */
+#define HISTORY_COMMANDS(X) \
+	X(rl_get_previous_history) \
+	X(rl_get_next_history) \
+	X(rl_beginning_of_history) \
+	X(rl_end_of_history) \
+	X(rl_operate_and_get_next) \
+	X(rl_fetch_history) \
+	X(rl_reverse_search_history) \
+	X(rl_forward_search_history) \
+	X(rl_history_search_forward) \
+	X(rl_history_search_backward) \
+	X(rl_history_substr_search_forward) \
+	X(rl_history_substr_search_backward) \
+	X(rl_noninc_forward_search) \
+	X(rl_noninc_reverse_search) \
+	X(rl_noninc_forward_search_again) \
+	X(rl_noninc_reverse_search_again) \
+	X(rl_yank_nth_arg) \
+	X(rl_yank_last_arg) \
+	X(rl_vi_yank_arg) \
+	X(rl_vi_fetch_history) \
+	X(rl_vi_search) \
+	X(rl_vi_search_again)
+
+#define LAZY_COMMAND(func) \
+	static int lazy_##func(int count, int key) \
+	{ \
+		load_history(); \
+		return func(count, key); \
+	}
+HISTORY_COMMANDS(LAZY_COMMAND)
+
+/* The readline commands that read the history, with their lazy versions */
+#define COMMAND_ENTRY(func) {func, lazy_##func},
+static const struct {
+	rl_command_func_t *func;
+	rl_command_func_t *lazy;
+} history_commands[] = {
+	HISTORY_COMMANDS(COMMAND_ENTRY)
+};
+
+/*
+ * Bind every key that recalls the history to the lazy version of its
+ * command. Runs as the startup hook of the first readline() call, after
+ * readline has read the inputrc.
+ */
+static int bind_lazy_history(void)
+{
+	static const char *maps[] = {"emacs", "vi-command", "vi-insert"};
+	size_t i, j;
+	char **keys, **key;
+
+	rl_startup_hook = NULL;
+	for (i = 0; i < sizeof(maps) / sizeof(maps[0]); i++) {
+		Keymap map = rl_get_keymap_by_name(maps[i]);
+
+		for (j = 0; j < sizeof(history_commands) / sizeof(history_commands[0]); j++) {
+			keys = rl_invoking_keyseqs_in_map(history_commands[j].func, map);
+			for (key = keys; key && *key; key++) {
+				rl_bind_keyseq_in_map(*key, history_commands[j].lazy, map);
+				free(*key);
+			}
+			free(keys);
+		}
+	}
+	return 0;
 }
 
 void my_yylex_destroy(void)
@@ -63,21 +436,26 @@ void my_yylex_destroy(void)
 
 int main(int argc, char *argv[])
 {
-	int save_history = 0;
+	int use_history = 0;
 	char *line;
+	size_t len;
 	int opt;
 
 	atexit(&arena_pop_all);
     atexit(&shell_exit);
 
 	/* Command-line argument parsing */
-	while ((opt = getopt(argc, argv, "hec:")) != -1) {
+	while ((opt = getopt(argc, argv, "henfpt:c:")) != -1) {
 		switch (opt) {
 		case 'h':
 			printf("usage: %s [OPTS] [FILE]\n"
 			       "options:\n"
 			       " -h      print this help.\n"
 			       " -e      echo commands before running them.\n"
+			       " -n      read commands but do not run them.\n"
+			       " -f      always fork() external commands, do not spawn them.\n"
+			       " -p      parse every line, do not cache the plans of lines.\n"
+			       " -t FD   write an execution trace to file descriptor FD.\n"
 			       " -c CMD  run this command then exit.\n"
 			       " FILE    read commands from FILE.\n",
 			       argv[0]);
@@ -87,43 +465,78 @@ int main(int argc, char *argv[])
 			echo = 1;
 			break;
 
+		case 'n':
+			noexec = 1;
+			break;
+
+		case 'f':
+			use_spawn = 0;
+			break;
+
+		case 'p':
+			use_plan_cache = 0;
+			break;
+
+		case 't':
+			trace_fd = atoi(optarg);
+			/* The trace is not passed on to the programs the shell starts. */
+			if (fcntl(trace_fd, F_SETFD, FD_CLOEXEC) == -1) {
+				perror("-t");
+				return EXIT_FAILURE;
+			}
+			break;
+
 		case 'c':
 			initialize();
 			handle_command(optarg);
-			return 0;
+			return last_status;
 		}
 	}
 
-	/* Reading commands from either a script or stdin */
-	if (optind >= argc) {
-		/* Reading from stdin; handle history if terminal. */
-		if (isatty(0)) {
-			using_history();
-			read_history(0);
-			prompt = "42sh$ ";
-			save_history = 1;
-		}
-	} else {
-		/* Reading from file. */
-		FILE *f = fopen(argv[optind], "r");
-		if (!f) {
+	/* Reading commands from a script, without readline. */
+	if (optind < argc) {
+		int fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+		if (fd == -1) {
 			perror(argv[optind]);
 			exit(1);
 		}
-		rl_instream = f;
-		prompt = NULL;
+		initialize();
+		run_script(fd);
+		close(fd);
+		return last_status;
+	}
+
+	/* Reading from stdin; handle history if terminal. */
+	if (isatty(0)) {
+		using_history();
+		rl_startup_hook = bind_lazy_history;
+		prompt = "42sh$ ";
+		use_history = 1;
 	}
 
 	/* The main loop. */
 	initialize();
-	while ((line = readline(prompt))) {
-		if (save_history && line[0] != '\0') {
-			add_history(line);
-			write_history(NULL);
+	while (1) {
+		/* Report finished background jobs before showing the prompt */
+		jobs_notify();
+		/* Like bash, prompt for the lines of a here-document with "> " */
+		if (!(line = readline(prompt && heredoc_root ? "> " : prompt)))
+			break;
+
+		if (use_history && line[0] != '\0')
+			save_history(line);
+		/* Make room for the second 0 the lexer needs to scan in place */
+		len = strlen(line);
+		line = realloc(line, len + 2);
+		if (!line) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
 		}
-		handle_command(line);
+		line[len + 1] = '\0';
+		handle_line(line, len);
 		free(line);
 	}
+	finish_input();
 
-	return 0;
+	return last_status;
 }
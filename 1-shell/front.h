@@ -1,3 +1,10 @@
 #ifndef FRONT_H
 #define FRONT_H
+
+/*
+ * Run the command lines in `cmd` one by one, like the -c option does. Used
+ * by the bench builtin to run the command line it measures.
+ */
+void handle_command(const char *cmd);
+
 #endif
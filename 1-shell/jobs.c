@@ -0,0 +1,926 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the job table of the shell. Every command that starts processes (a simple
+ * command, a pipeline, a subshell or a detached command) is a job. All children are reaped by a
+ * SIGCHLD handler that calls waitpid() until there is nothing left to reap, and stores the status
+ * in the job table. Waiting for a job is waiting until the handler has seen all its processes
+ * finish, so the shell never reaps a process of another job by accident, and detached commands do
+ * not stay behind as zombies.
+ *
+ * In an interactive shell every job gets its own process group, which is given the terminal while
+ * the job runs in the foreground. This is what makes Ctrl+Z, fg and bg work.
+ *
+ * Children are reaped with wait4(), which also returns their resource usage. The time keyword uses
+ * this to report what every process of a command cost, and when $ACCOUNTING names a file, a
+ * record is appended to it for every process that finishes.
+ */
+
+#define _GNU_SOURCE
+
+#include "jobs.h"
+#include "parser/ast.h"
+#include "spawn.h"
+#include "trace.h"
+#include "vars.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+enum process_state { PROCESS_RUNNING, PROCESS_STOPPED, PROCESS_DONE };
+
+/* A process of a job. */
+struct process {
+    pid_t pid;
+    int status;
+    enum process_state state;
+    node_t *node; // the command of the process, only valid while the job runs in the foreground
+    struct timespec spawn; // right before the shell called fork() or posix_spawn() for it
+    struct timespec start; // once that call returned
+    struct timespec end;  // set once the process has finished
+    struct rusage usage;  // set once the process has finished
+    unsigned long trace_id; // the traced node that started the process
+};
+
+/* A job: the processes started for one command. */
+struct job {
+    int id;
+    pid_t pgid; // 0 until the first process has been added
+    int foreground;
+    node_t *node;  // the command, only valid while it is being run
+    char *command; // the command as text, once the job has been stopped or detached
+    struct process *processes;
+    size_t n_processes;
+    size_t processes_size;
+    struct job *next_free; // the next job in the free list
+};
+
+// The maximum number of finished jobs that is kept around for reuse.
+#define MAX_FREE_JOBS 8
+
+int job_control = 0;
+
+static pid_t shell_pgid;
+static struct job **jobs = NULL;
+static size_t n_jobs = 0;
+static size_t jobs_size = 0;
+
+// Finished jobs, with their process arrays, kept so starting a command does not have to allocate.
+static struct job *free_jobs = NULL;
+static size_t n_free_jobs = 0;
+
+// In a child of the shell: the jobs of the parent when it was forked, as `jobs` lists them, or NULL.
+static char *parent_jobs = NULL;
+
+// Where the time keyword that runs collects resource usage, or NULL.
+static struct job_usage *job_usage = NULL;
+
+// The number of nested block_sigchld() calls, and the signal mask from before the first one.
+static int block_depth = 0;
+static sigset_t unblocked_mask;
+
+/* Block SIGCHLD, so the job table can be changed without the handler seeing it half-way. */
+static void block_sigchld(void) {
+    if (block_depth++ == 0) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &set, &unblocked_mask);
+    }
+}
+
+/* Undo a block_sigchld() call. */
+static void unblock_sigchld(void) {
+    if (--block_depth == 0) {
+        sigprocmask(SIG_SETMASK, &unblocked_mask, NULL);
+    }
+}
+
+/* Find a process in the job table.
+ *
+ * pid: the pid of the process
+ *
+ * Returns:
+ * the process, or NULL if it is not part of a job
+ */
+static struct process *find_process(pid_t pid) {
+    for (size_t i = 0; i < n_jobs; i++) {
+        for (size_t j = 0; j < jobs[i]->n_processes; j++) {
+            if (jobs[i]->processes[j].pid == pid) {
+                return &jobs[i]->processes[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Signal handler for SIGCHLD.
+ *
+ * Reaps all children that have changed state without blocking, and stores their new state in the
+ * job table. Children that are not part of a job are reaped as well.
+ */
+static void sigchld_handler(int sig) {
+    int saved_errno = errno;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    (void)sig;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        struct process *process = find_process(pid);
+        if (process == NULL) {
+            continue;
+        }
+        if (WIFSTOPPED(status)) {
+            process->state = PROCESS_STOPPED;
+            process->status = status;
+        } else if (WIFCONTINUED(status)) {
+            process->state = PROCESS_RUNNING;
+        } else {
+            process->state = PROCESS_DONE;
+            process->status = status;
+            process->usage = usage;
+            clock_gettime(CLOCK_MONOTONIC, &process->end);
+        }
+    }
+    errno = saved_errno;
+}
+
+/* Determine the state of a job.
+ *
+ * job: the job
+ *
+ * Returns:
+ * PROCESS_RUNNING if any of its processes runs, otherwise PROCESS_STOPPED if any of them is
+ * stopped, otherwise PROCESS_DONE
+ */
+static enum process_state job_state(const struct job *job) {
+    enum process_state state = PROCESS_DONE;
+
+    for (size_t i = 0; i < job->n_processes; i++) {
+        if (job->processes[i].state == PROCESS_RUNNING) {
+            return PROCESS_RUNNING;
+        }
+        if (job->processes[i].state == PROCESS_STOPPED) {
+            state = PROCESS_STOPPED;
+        }
+    }
+    return state;
+}
+
+/* Convert a wait status to an exit status.
+ *
+ * status: the wait status, as returned by waitpid()
+ *
+ * Returns:
+ * the exit code of the process, or 128 plus the signal that killed or stopped it
+ */
+static int exit_status(int status) {
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/* Print a word of a command. A marked character is printed with a backslash, the escape it was read
+ * from.
+ *
+ * f: the stream to print to
+ * word: the word
+ */
+static void print_word(FILE *f, const char *word) {
+    for (; *word != '\0'; word++) {
+        if (*word == LITERAL_MARK && word[1] != '\0') {
+            fputc('\\', f);
+            word++;
+        }
+        fputc(*word, f);
+    }
+}
+
+/* Print a command in the syntax of the shell.
+ *
+ * f: the stream to print to
+ * node: the command
+ */
+static void print_command(FILE *f, const node_t *node) {
+    int input;
+
+    switch (node->type) {
+    case NODE_COMMAND:
+        for (size_t i = 0; i < node->command.argc; i++) {
+            if (i != 0) {
+                fputc(' ', f);
+            }
+            print_word(f, node->command.argv[i]);
+            if (i < node->command.n_substs && node->command.substs[i] != NULL) {
+                print_command(f, node->command.substs[i]);
+                fprintf(f, ")");
+            }
+        }
+        break;
+    case NODE_PIPE:
+        for (size_t i = 0; i < node->pipe.n_parts; i++) {
+            if (i != 0) {
+                fprintf(f, " | ");
+            }
+            print_command(f, node->pipe.parts[i]);
+        }
+        break;
+    case NODE_REDIRECT:
+        input = node->redirect.mode == REDIRECT_INPUT || node->redirect.mode == REDIRECT_HEREDOC ||
+                node->redirect.mode == REDIRECT_HERESTRING;
+        if (node->redirect.fd == -1) {
+            fprintf(f, "&");
+        } else if (node->redirect.fd != (input ? 0 : 1)) {
+            fprintf(f, "%d", node->redirect.fd);
+        }
+        switch (node->redirect.mode) {
+        case REDIRECT_DUP:
+            fprintf(f, ">&%d ", node->redirect.fd2);
+            break;
+        case REDIRECT_INPUT:
+            fprintf(f, "<");
+            print_word(f, node->redirect.target);
+            fputc(' ', f);
+            break;
+        case REDIRECT_OUTPUT:
+            fprintf(f, ">");
+            print_word(f, node->redirect.target);
+            fputc(' ', f);
+            break;
+        case REDIRECT_APPEND:
+            fprintf(f, ">>");
+            print_word(f, node->redirect.target);
+            fputc(' ', f);
+            break;
+        case REDIRECT_HEREDOC:
+            // The delimiter is gone once the body has been read.
+            fprintf(f, "<<... ");
+            break;
+        case REDIRECT_HERESTRING:
+            fprintf(f, "<<<");
+            print_word(f, node->redirect.target);
+            fputc(' ', f);
+            break;
+        }
+        print_command(f, node->redirect.child);
+        break;
+    case NODE_SUBSHELL:
+        fprintf(f, "( ");
+        print_command(f, node->subshell.child);
+        fprintf(f, " )");
+        break;
+    case NODE_DETACH:
+        print_command(f, node->detach.child);
+        fprintf(f, " &");
+        break;
+    case NODE_SEQUENCE:
+        print_command(f, node->sequence.first);
+        fprintf(f, "; ");
+        print_command(f, node->sequence.second);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        print_command(f, node->and_or.first);
+        fprintf(f, node->type == NODE_AND ? " && " : " || ");
+        print_command(f, node->and_or.second);
+        break;
+    case NODE_TIME:
+        fprintf(f, node->time.posix ? "time -p " : "time ");
+        print_command(f, node->time.child);
+        break;
+    case NODE_PARALLEL:
+        fprintf(f, "{ ");
+        for (size_t i = 0; i < node->parallel.n_parts; i++) {
+            if (i != 0) {
+                fprintf(f, " ;; ");
+            }
+            print_command(f, node->parallel.parts[i]);
+        }
+        fprintf(f, " }");
+        break;
+    }
+}
+
+/* Store the command of a job as text, as its tree may be freed while the job still exists.
+ *
+ * job: the job
+ */
+static void describe_job(struct job *job) {
+    size_t size;
+    FILE *f;
+
+    if (job->command != NULL || job->node == NULL) {
+        return;
+    }
+
+    f = open_memstream(&job->command, &size);
+    if (f == NULL) {
+        perror("open_memstream");
+        exit(EXIT_FAILURE);
+    }
+    print_command(f, job->node);
+    fclose(f);
+    job->node = NULL;
+    for (size_t i = 0; i < job->n_processes; i++) {
+        job->processes[i].node = NULL;
+    }
+}
+
+/* Compute the time between two points on the monotonic clock.
+ *
+ * start: the first point
+ * end: the second point
+ *
+ * Returns:
+ * the time in seconds
+ */
+static double elapsed(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Convert a time from a struct rusage to seconds.
+ *
+ * tv: the time
+ *
+ * Returns:
+ * the time in seconds
+ */
+static double seconds(const struct timeval *tv) { return tv->tv_sec + tv->tv_usec / 1e6; }
+
+/* Print the resource usage of a finished process.
+ *
+ * f: the stream to print to
+ * job: the job of the process
+ * process: the process
+ * format: the format of a line, gets the pid, exit status, real/user/sys time in seconds, maximum
+ *         resident set size in KiB, voluntary and involuntary context switches and the command
+ */
+static void print_usage(FILE *f, const struct job *job, const struct process *process,
+                        const char *format) {
+    fprintf(f, format, (int)process->pid, exit_status(process->status),
+            elapsed(&process->start, &process->end), seconds(&process->usage.ru_utime),
+            seconds(&process->usage.ru_stime), process->usage.ru_maxrss,
+            process->usage.ru_nvcsw, process->usage.ru_nivcsw);
+    if (process->node != NULL) {
+        print_command(f, process->node);
+    } else if (job->command != NULL) {
+        fprintf(f, "%s", job->command);
+    } else if (job->node != NULL) {
+        print_command(f, job->node);
+    }
+    fprintf(f, "\n");
+}
+
+/* Account for the resource usage of a job that has finished.
+ *
+ * While the time keyword runs, every process of a foreground job is reported on the standard
+ * error and added to job_usage. When $ACCOUNTING is set, a tab-separated record per process is
+ * appended to the file it names, and when tracing is enabled, every process is written to the
+ * trace.
+ *
+ * job: the job
+ */
+static void account_job(const struct job *job) {
+    const char *path = var_get("ACCOUNTING");
+
+    if (job_usage != NULL && job->foreground) {
+        for (size_t i = 0; i < job->n_processes; i++) {
+            const struct process *process = &job->processes[i];
+            if (!job_usage->posix) {
+                print_usage(stderr, job, process,
+                            "time: pid %d status %d real %.3fs user %.3fs sys %.3fs rss %ldk "
+                            "csw %ld+%ld: ");
+            }
+            job_usage->user += seconds(&process->usage.ru_utime);
+            job_usage->sys += seconds(&process->usage.ru_stime);
+            if (process->usage.ru_maxrss > job_usage->max_rss) {
+                job_usage->max_rss = process->usage.ru_maxrss;
+            }
+            job_usage->nvcsw += process->usage.ru_nvcsw;
+            job_usage->nivcsw += process->usage.ru_nivcsw;
+        }
+    }
+
+    if (trace_fd != -1) {
+        // The shell is done waiting for the job now, which may be well after it was reaped.
+        struct timespec waited;
+        clock_gettime(CLOCK_MONOTONIC, &waited);
+        for (size_t i = 0; i < job->n_processes; i++) {
+            const struct process *process = &job->processes[i];
+            trace_process(process->trace_id, process->pid, process->node, &process->spawn,
+                          &process->start, &process->end, &waited, exit_status(process->status));
+        }
+    }
+
+    if (path != NULL && *path != '\0' && job->n_processes > 0) {
+        FILE *f = fopen(path, "ae");
+        if (f == NULL) {
+            perror(path);
+            return;
+        }
+        for (size_t i = 0; i < job->n_processes; i++) {
+            print_usage(f, job, &job->processes[i], "%d\t%d\t%.6f\t%.6f\t%.6f\t%ld\t%ld\t%ld\t");
+        }
+        fclose(f);
+    }
+}
+
+/* Remove a job from the job table and free it, or keep it in the free list for reuse.
+ *
+ * job: the job
+ */
+static void remove_job(struct job *job) {
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (jobs[i] == job) {
+            memmove(&jobs[i], &jobs[i + 1], (n_jobs - i - 1) * sizeof(jobs[0]));
+            n_jobs--;
+            break;
+        }
+    }
+    free(job->command);
+    if (n_free_jobs < MAX_FREE_JOBS) {
+        job->next_free = free_jobs;
+        free_jobs = job;
+        n_free_jobs++;
+        return;
+    }
+    free(job->processes);
+    free(job);
+}
+
+/* Send SIGCONT to all processes of a job that have not finished.
+ *
+ * job: the job
+ */
+static void continue_job(struct job *job) {
+    if (job_control && job->pgid != 0) {
+        kill(-job->pgid, SIGCONT);
+    }
+    for (size_t i = 0; i < job->n_processes; i++) {
+        if (job->processes[i].state != PROCESS_DONE) {
+            if (!job_control) {
+                kill(job->processes[i].pid, SIGCONT);
+            }
+            job->processes[i].state = PROCESS_RUNNING;
+        }
+    }
+}
+
+/* Find the job a builtin refers to.
+ *
+ * arg: "%N" or "N" for job N, or NULL for the current job (the most recent one)
+ * builtin: the name of the builtin, used in error messages
+ *
+ * Returns:
+ * the job, or NULL after printing an error if there is no such job
+ */
+static struct job *find_job(const char *arg, const char *builtin) {
+    if (arg == NULL) {
+        if (n_jobs == 0) {
+            fprintf(stderr, "%s: no current job\n", builtin);
+            return NULL;
+        }
+        return jobs[n_jobs - 1];
+    }
+
+    int id = atoi(arg[0] == '%' ? arg + 1 : arg);
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (jobs[i]->id == id) {
+            return jobs[i];
+        }
+    }
+    fprintf(stderr, "%s: %s: no such job\n", builtin, arg);
+    return NULL;
+}
+
+/* Check whether `jobs` lists a job. Jobs in the foreground are not listed: they have no command
+ * text yet, and the shell is waiting for them while `jobs` runs in a child of it.
+ *
+ * job: the job
+ * skip: a job that is not listed, or NULL
+ *
+ * Returns:
+ * 1 if the job is listed, 0 otherwise
+ */
+static int job_listed(const struct job *job, const struct job *skip) {
+    return job != skip && !job->foreground && job->command != NULL;
+}
+
+/* List the jobs in the job table. SIGCHLD must be blocked.
+ *
+ * f: the stream to list them on
+ * skip: a job that is not listed, or NULL
+ */
+static void print_jobs(FILE *f, const struct job *skip) {
+    static const char *state_names[] = {"Running", "Stopped", "Done"};
+    size_t last = n_jobs;
+
+    while (last > 0 && !job_listed(jobs[last - 1], skip)) {
+        last--;
+    }
+    for (size_t i = 0; i < last; i++) {
+        if (!job_listed(jobs[i], skip)) {
+            continue;
+        }
+        enum process_state state = job_state(jobs[i]);
+        fprintf(f, "[%d]%c  %-24s%s%s\n", jobs[i]->id, i == last - 1 ? '+' : ' ',
+                state_names[state], jobs[i]->command, state == PROCESS_RUNNING ? " &" : "");
+    }
+}
+
+void jobs_init(int interactive) {
+    struct sigaction action;
+
+    action.sa_handler = sigchld_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &action, NULL) == -1) {
+        perror("sigaction");
+    }
+
+    if (!interactive || !isatty(STDIN_FILENO)) {
+        return;
+    }
+
+    // Wait until the shell has been put in the foreground, e.g. when started with "42sh &".
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+        kill(-shell_pgid, SIGTTIN);
+    }
+
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    // Put the shell in its own process group, unless it already is (e.g. as session leader).
+    if (shell_pgid != getpid() && setpgid(0, 0) == -1) {
+        perror("setpgid");
+        return;
+    }
+    shell_pgid = getpid();
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1) {
+        perror("tcsetpgrp");
+        return;
+    }
+    job_control = 1;
+}
+
+struct job *job_create(node_t *node, int foreground) {
+    struct job *job;
+
+    block_sigchld();
+
+    if (free_jobs != NULL) {
+        job = free_jobs;
+        free_jobs = job->next_free;
+        n_free_jobs--;
+        *job = (struct job){.processes = job->processes, .processes_size = job->processes_size};
+    } else {
+        job = calloc(1, sizeof(*job));
+        if (job == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    job->foreground = foreground;
+    job->node = node;
+
+    if (n_jobs == jobs_size) {
+        jobs_size = jobs_size ? 2 * jobs_size : 8;
+        jobs = realloc(jobs, jobs_size * sizeof(jobs[0]));
+        if (jobs == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    job->id = n_jobs ? jobs[n_jobs - 1]->id + 1 : 1;
+    jobs[n_jobs++] = job;
+
+    return job;
+}
+
+pid_t job_pgid(const struct job *job) { return job_control ? job->pgid : -1; }
+
+void job_add_process(struct job *job, pid_t pid, node_t *node) {
+    if (job->n_processes == job->processes_size) {
+        job->processes_size = job->processes_size ? 2 * job->processes_size : 4;
+        job->processes = realloc(job->processes, job->processes_size * sizeof(job->processes[0]));
+        if (job->processes == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct process *process = &job->processes[job->n_processes++];
+    *process = (struct process){.pid = pid,
+                                .state = PROCESS_RUNNING,
+                                .node = node,
+                                .spawn = spawn_stats.began,
+                                .trace_id = trace_id};
+    clock_gettime(CLOCK_MONOTONIC, &process->start);
+
+    if (job_control) {
+        if (job->pgid == 0) {
+            job->pgid = pid;
+        }
+        // The child does the same, whichever of both runs first. Once the child has started a
+        // program this fails, but then the child has already done it.
+        setpgid(pid, job->pgid);
+    }
+}
+
+void job_enter_child(const struct job *job) {
+    if (job_control) {
+        if (job != NULL) {
+            pid_t pgid = job->pgid ? job->pgid : getpid();
+            setpgid(0, pgid);
+            if (job->foreground) {
+                tcsetpgrp(STDIN_FILENO, pgid);
+            }
+        }
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+
+    // The jobs of the parent are not children of this process, but like in bash `jobs` still lists
+    // them as they were when the child was forked, except the job of the child itself and the jobs
+    // in the foreground. `job` is freed here as well.
+    if (n_jobs > 0) {
+        char *snapshot;
+        size_t len;
+        FILE *f = open_memstream(&snapshot, &len);
+        if (f != NULL) {
+            if (parent_jobs != NULL) {
+                fputs(parent_jobs, f);
+            }
+            print_jobs(f, job);
+            if (fclose(f) == 0) {
+                free(parent_jobs);
+                parent_jobs = snapshot;
+            }
+        }
+    }
+    while (n_jobs > 0) {
+        remove_job(jobs[n_jobs - 1]);
+    }
+    job_control = 0;
+    job_usage = NULL;
+
+    block_depth = 0;
+    sigprocmask(SIG_SETMASK, &unblocked_mask, NULL);
+}
+
+int job_wait_limit(struct job *job, size_t limit) {
+    sigset_t wait_mask = unblocked_mask;
+
+    sigdelset(&wait_mask, SIGCHLD);
+
+    // The terminal is taken back by job_wait(), once the whole job has finished.
+    if (job_control && job->pgid != 0) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+    for (;;) {
+        size_t running = 0;
+        for (size_t i = 0; i < job->n_processes; i++) {
+            if (job->processes[i].state == PROCESS_STOPPED) {
+                return -1;
+            }
+            running += job->processes[i].state == PROCESS_RUNNING;
+        }
+        if (running <= limit) {
+            break;
+        }
+        sigsuspend(&wait_mask);
+    }
+
+    for (size_t i = 0; i < job->n_processes; i++) {
+        if (job->processes[i].state == PROCESS_DONE && job->processes[i].status != 0) {
+            return exit_status(job->processes[i].status);
+        }
+    }
+    return 0;
+}
+
+int job_wait(struct job *job) {
+    sigset_t wait_mask = unblocked_mask;
+    int status = 0;
+
+    sigdelset(&wait_mask, SIGCHLD);
+
+    if (job_control && job->pgid != 0) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+    while (job_state(job) == PROCESS_RUNNING) {
+        sigsuspend(&wait_mask);
+    }
+    if (job_control) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    }
+
+    if (job->n_processes > 0) {
+        status = exit_status(job->processes[job->n_processes - 1].status);
+    }
+
+    if (job_state(job) == PROCESS_STOPPED) {
+        job->foreground = 0;
+        describe_job(job);
+        fprintf(stderr, "\n[%d]+  Stopped                 %s\n", job->id, job->command);
+    } else {
+        account_job(job);
+        remove_job(job);
+    }
+
+    unblock_sigchld();
+    return status;
+}
+
+void job_usage_begin(struct job_usage *usage, int posix) {
+    struct rusage self;
+
+    getrusage(RUSAGE_SELF, &self);
+    *usage = (struct job_usage){.outer = job_usage,
+                                .posix = posix,
+                                .self_user = seconds(&self.ru_utime),
+                                .self_sys = seconds(&self.ru_stime)};
+    clock_gettime(CLOCK_MONOTONIC, &usage->start);
+    job_usage = usage;
+}
+
+void job_usage_end(struct job_usage *usage) {
+    struct rusage self;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self);
+    job_usage = usage->outer;
+
+    double real = elapsed(&usage->start, &end);
+    double user = usage->user + seconds(&self.ru_utime) - usage->self_user;
+    double sys = usage->sys + seconds(&self.ru_stime) - usage->self_sys;
+    if (usage->posix) {
+        fprintf(stderr, "real %.2f\nuser %.2f\nsys %.2f\n", real, user, sys);
+    } else {
+        fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\n", (int)(real / 60),
+                real - 60 * (int)(real / 60), (int)(user / 60), user - 60 * (int)(user / 60),
+                (int)(sys / 60), sys - 60 * (int)(sys / 60));
+    }
+
+    // The processes are part of what an enclosing time keyword measures as well.
+    if (job_usage != NULL) {
+        job_usage->user += usage->user;
+        job_usage->sys += usage->sys;
+        if (usage->max_rss > job_usage->max_rss) {
+            job_usage->max_rss = usage->max_rss;
+        }
+        job_usage->nvcsw += usage->nvcsw;
+        job_usage->nivcsw += usage->nivcsw;
+    }
+}
+
+void job_detach(struct job *job) {
+    job->foreground = 0;
+    describe_job(job);
+    if (job_control && job->n_processes > 0) {
+        fprintf(stderr, "[%d] %d\n", job->id, (int)job->processes[job->n_processes - 1].pid);
+    }
+    unblock_sigchld();
+}
+
+void jobs_notify(void) {
+    block_sigchld();
+    for (size_t i = 0; i < n_jobs;) {
+        if (job_state(jobs[i]) != PROCESS_DONE) {
+            i++;
+            continue;
+        }
+        if (job_control) {
+            fprintf(stderr, "[%d]+  Done                    %s\n", jobs[i]->id, jobs[i]->command);
+        }
+        account_job(jobs[i]);
+        remove_job(jobs[i]);
+    }
+    unblock_sigchld();
+}
+
+void jobs_print(void) {
+    if (parent_jobs != NULL) {
+        fputs(parent_jobs, stdout);
+    }
+    block_sigchld();
+    print_jobs(stdout, NULL);
+    unblock_sigchld();
+}
+
+int jobs_fg(const char *arg) {
+    block_sigchld();
+
+    struct job *job = find_job(arg, "fg");
+    if (job == NULL) {
+        unblock_sigchld();
+        return 1;
+    }
+
+    printf("%s\n", job->command);
+    fflush(stdout);
+    job->foreground = 1;
+    continue_job(job);
+
+    // Also undoes the block_sigchld() above.
+    return job_wait(job);
+}
+
+int jobs_bg(const char *arg) {
+    block_sigchld();
+
+    struct job *job = find_job(arg, "bg");
+    if (job != NULL) {
+        continue_job(job);
+        printf("[%d]+ %s &\n", job->id, job->command);
+    }
+
+    unblock_sigchld();
+    return job != NULL ? 0 : 1;
+}
+
+/* Check whether a job contains a process.
+ *
+ * job: the job
+ * pid: the pid of the process
+ *
+ * Returns:
+ * 1 if the process is part of the job, 0 otherwise
+ */
+static int job_has_process(const struct job *job, pid_t pid) {
+    for (size_t i = 0; i < job->n_processes; i++) {
+        if (job->processes[i].pid == pid) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int jobs_wait(const char *arg) {
+    sigset_t wait_mask;
+    struct job *job = NULL;
+    int status = 0;
+
+    block_sigchld();
+    wait_mask = unblocked_mask;
+    sigdelset(&wait_mask, SIGCHLD);
+
+    if (arg != NULL && arg[0] != '%') {
+        pid_t pid = atoi(arg);
+        for (size_t i = 0; i < n_jobs && job == NULL; i++) {
+            if (job_has_process(jobs[i], pid)) {
+                job = jobs[i];
+            }
+        }
+        if (job == NULL) {
+            fprintf(stderr, "wait: pid %s is not a child of this shell\n", arg);
+            unblock_sigchld();
+            return 127;
+        }
+    } else if (arg != NULL && (job = find_job(arg, "wait")) == NULL) {
+        unblock_sigchld();
+        return 127;
+    }
+
+    // Without an argument, wait for all jobs that are running.
+    for (size_t i = 0; i < n_jobs;) {
+        if ((job == NULL || jobs[i] == job) && job_state(jobs[i]) == PROCESS_RUNNING) {
+            sigsuspend(&wait_mask);
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    // Jobs that were waited for are not reported as done.
+    for (size_t i = 0; i < n_jobs;) {
+        if ((job == NULL || jobs[i] == job) && job_state(jobs[i]) == PROCESS_DONE) {
+            if (jobs[i] == job && job->n_processes > 0) {
+                status = exit_status(job->processes[job->n_processes - 1].status);
+            }
+            account_job(jobs[i]);
+            remove_job(jobs[i]);
+        } else {
+            i++;
+        }
+    }
+
+    unblock_sigchld();
+    return status;
+}
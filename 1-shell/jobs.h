@@ -0,0 +1,127 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+#include <time.h>
+
+struct tree_node;
+struct job;
+
+/*
+ * Non-zero when the shell does job control: each job gets its own process
+ * group, and foreground jobs get the terminal. Only an interactive top-level
+ * shell does job control.
+ */
+extern int job_control;
+
+/*
+ * The resource usage collected for the time keyword. Times are in seconds,
+ * the resident set size in KiB.
+ */
+struct job_usage {
+    struct job_usage *outer; // of an enclosing time keyword, or NULL
+    int posix;               // only print the totals, in the format of POSIX
+    struct timespec start;
+    double self_user;        // of the shell itself, when collecting started
+    double self_sys;
+    double user;
+    double sys;
+    long max_rss;
+    long nvcsw;
+    long nivcsw;
+};
+
+/*
+ * Install the SIGCHLD handler that reaps all children, and set up job control
+ * if `interactive` is non-zero and the standard input is a terminal. Called
+ * once when the shell starts.
+ */
+void jobs_init(int interactive);
+
+/*
+ * Start a new job for the command `node`. SIGCHLD is blocked until the job
+ * is waited for with job_wait() or put in the background with job_detach(),
+ * so no process of the job is reaped before it has been added.
+ */
+struct job *job_create(struct tree_node *node, int foreground);
+
+/*
+ * The process group the next process of `job` must join: -1 if there is no
+ * job control, 0 for a new group (the first process) or the group of the
+ * job.
+ */
+pid_t job_pgid(const struct job *job);
+
+/*
+ * Add the started process `pid`, which runs the command `node`, to `job`.
+ */
+void job_add_process(struct job *job, pid_t pid, struct tree_node *node);
+
+/*
+ * Called in a forked child that belongs to `job`, before it runs anything.
+ * Puts the child in the process group of the job, restores the signals the
+ * shell ignores and forgets all jobs of the parent shell. `job` is NULL for a
+ * child that is not part of a job, like a process substitution: it stays in
+ * the process group of the shell.
+ */
+void job_enter_child(const struct job *job);
+
+/*
+ * Wait until at most `limit` processes of the foreground job `job` are still
+ * running, so more processes can be added without going over a concurrency
+ * limit. The job stays in the job table: it must be finished with job_wait().
+ *
+ * Returns the exit status of the first process, in the order they were added,
+ * that has finished with a non-zero status, 0 if there is none, or -1 if a
+ * process of the job has stopped.
+ */
+int job_wait_limit(struct job *job, size_t limit);
+
+/*
+ * Wait until all processes of the foreground job `job` have finished or one
+ * has stopped. A stopped job stays in the job table, a finished job is
+ * removed.
+ *
+ * Returns the exit status of the last process of the job, as $? shows it: its
+ * exit code, or 128 plus the number of the signal that killed or stopped it.
+ */
+int job_wait(struct job *job);
+
+/*
+ * Start collecting resource usage in `usage` for the time keyword. Until
+ * job_usage_end() is called, every process of a foreground job that finishes
+ * is added to `usage`, and reported on the standard error unless `posix` is
+ * set. Calls can nest.
+ */
+void job_usage_begin(struct job_usage *usage, int posix);
+
+/*
+ * Stop collecting resource usage in `usage` and print the totals on the
+ * standard error: the wall-clock time since job_usage_begin(), and the user
+ * and system time of all processes together with the shell itself. With
+ * `posix` set they are printed as "real %f" lines, as time -p does.
+ */
+void job_usage_end(struct job_usage *usage);
+
+/*
+ * Let `job` run in the background.
+ */
+void job_detach(struct job *job);
+
+/*
+ * Report background jobs that have finished, and remove them from the job
+ * table. Called once for every command line.
+ */
+void jobs_notify(void);
+
+/*
+ * The builtins: "jobs", "fg [%N]", "bg [%N]" and "wait [%N|PID]". `arg` is the
+ * argument, or NULL if none was given. The functions return the exit status of
+ * the builtin.
+ */
+void jobs_print(void);
+int jobs_fg(const char *arg);
+int jobs_bg(const char *arg);
+int jobs_wait(const char *arg);
+
+#endif
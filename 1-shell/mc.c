@@ -1,17 +1,29 @@
 #include "mc.h"
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+// Initial number of slots in the index, must be a power of two.
+#define INITIAL_SLOTS 16
+
+// Registered memory is kept in a doubly linked list, so it can be freed in
+// the reverse order of registration and removed from the middle in O(1).
 struct m_node {
 	struct m_node *next;
+	struct m_node *prev;
 	void *pt;
 	free_fun fun;
 };
 
+// Besides the list, every node is indexed by its pointer in an open
+// addressing hash table with linear probing, so looking up a pointer does not
+// need to walk the list.
 struct mc {
 	m_node *header;
 	size_t n;
+	m_node **slots;
+	size_t n_slots;
 };
 
 mc *mc_init()
@@ -21,16 +33,72 @@ mc *mc_init()
 		exit(EXIT_FAILURE);
 	res->n = 0;
 	res->header = NULL;
+	res->slots = calloc(INITIAL_SLOTS, sizeof(m_node *));
+	if (NULL == res->slots)
+		exit(EXIT_FAILURE);
+	res->n_slots = INITIAL_SLOTS;
 	return res;
 }
 
+static size_t slot_of(const mc *m, const void *pt)
+{
+	// Fibonacci hashing; the low bits of a pointer are mostly alignment.
+	uint64_t h = (uint64_t)(uintptr_t)pt * 0x9E3779B97F4A7C15ull;
+	return (size_t)(h >> 32) & (m->n_slots - 1);
+}
+
+static size_t find_slot(const mc *m, const void *pt)
+{
+	size_t i = slot_of(m, pt);
+	while (m->slots[i] && m->slots[i]->pt != pt)
+		i = (i + 1) & (m->n_slots - 1);
+	return i;
+}
+
+static void grow_index(mc *m)
+{
+	m_node **old = m->slots;
+	size_t old_n = m->n_slots;
+
+	m->n_slots *= 2;
+	m->slots = calloc(m->n_slots, sizeof(m_node *));
+	if (NULL == m->slots)
+		exit(EXIT_FAILURE);
+	for (size_t i = 0; i < old_n; i++) {
+		if (old[i])
+			m->slots[find_slot(m, old[i]->pt)] = old[i];
+	}
+	free(old);
+}
+
+// Remove the entry in slot `i` using backward shift deletion, so no
+// tombstones are needed.
+static void remove_slot(mc *m, size_t i)
+{
+	size_t mask = m->n_slots - 1;
+	size_t j = i;
+
+	m->slots[i] = NULL;
+	while (1) {
+		j = (j + 1) & mask;
+		if (!m->slots[j])
+			return;
+		size_t home = slot_of(m, m->slots[j]->pt);
+		// Move the entry in `j` to the hole in `i` if its home slot is not
+		// in the (cyclic) range (i, j].
+		if ((j > i && (home <= i || home > j)) ||
+		    (j < i && (home <= i && home > j))) {
+			m->slots[i] = m->slots[j];
+			m->slots[j] = NULL;
+			i = j;
+		}
+	}
+}
+
 static void assert_new_pt(mc *m, void *pt)
 {
 #ifndef NDEBUG
-	m_node *cur = m->header;
-	for (size_t i = 0; i < m->n; i++, cur = cur->next) {
-		assert(pt != cur->pt);
-	}
+	assert(m->slots[find_slot(m, pt)] == NULL);
 #else
 	(void)m;
 	(void)pt;
@@ -80,10 +148,18 @@ void mc_register_mem(mc *m, void *pt, const free_fun fun)
 	// Make sure pointer is unique to prevent double free errors.
 	assert_new_pt(m, pt);
 
+	// Keep the load factor of the index at or below one half.
+	if (2 * (m->n + 1) > m->n_slots)
+		grow_index(m);
+
 	new_node->fun = fun;
 	new_node->pt = pt;
+	new_node->prev = NULL;
 	new_node->next = m->header;
+	if (m->header)
+		m->header->prev = new_node;
 	m->header = new_node;
+	m->slots[find_slot(m, pt)] = new_node;
 	m->n++;
 }
 
@@ -96,6 +172,7 @@ void mc_free_all_mem(mc *m)
 		free(cur);
 		cur = next;
 	}
+	free(m->slots);
 	free(m);
 }
 
@@ -107,26 +184,27 @@ void mc_unregister_all_mem(mc *m)
 		free(cur);
 		cur = next;
 	}
+	free(m->slots);
 	free(m);
 }
 
 m_node *mc_unregister_mem(mc *m, const void *pt)
 {
-	m_node *cur = m->header->next, *prev = m->header;
+	size_t i = find_slot(m, pt);
+	m_node *node = m->slots[i];
+
+	assert(node);
+	remove_slot(m, i);
+
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		m->header = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
 	m->n--;
-	if (pt == prev->pt) {
-		m->header = cur;
-		return prev;
-	}
-	for (size_t i = 0; i < m->n; i++) {
-		if (pt == cur->pt) {
-			prev->next = cur->next;
-			return cur;
-		}
-		prev = cur;
-		cur = cur->next;
-	}
-	assert(0);
+
+	return node;
 }
 
 void mc_free_mem(mc *m, void *pt)
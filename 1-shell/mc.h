@@ -12,7 +12,8 @@ typedef void (*free_fun)(void *pt);
 // Create a new mc.
 mc *mc_init();
 
-// Register the pointer `pt` with function `fun` in the given mc `m`.
+// Register the pointer `pt` with function `fun` in the given mc `m`. This is
+// O(1): pointers are indexed in a hash table.
 void mc_register_mem(mc *m, void *pt, const free_fun fun);
 
 // Free all memory in the given `m` by calling their accompanying functions with
@@ -25,13 +26,14 @@ void mc_free_mem(mc *m, void *pt);
 // Unregistered all memory in `m`. This DOES NOT free this memory.
 void mc_unregister_all_mem(mc *m);
 
-// Unregister the given pointer `pt` from `m`. This does not free this
-// memory. This function is useful for code like this:
+// Unregister the given pointer `pt` from `m` in O(1). This does not free this
+// memory. The returned node should be freed with `free`. This function is
+// useful for code like this:
 //
 // pt = mc_malloc(m, 1, sizeof(sturct ...));
 // if (unlikely) {
 //     free(pt);
-//     mc_unregister_mem(m, pt);
+//     free(mc_unregister_mem(m, pt));
 //     return 0;
 // } else {
 //     save_in_struct(st, pt);
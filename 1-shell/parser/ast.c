@@ -1,21 +1,65 @@
 #define _GNU_SOURCE
 #include "ast.h"
+#include "../arena.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
 #include <ctype.h>
 
+/*
+ * Grow an array holding `n` elements so there is room for one more. Arrays are
+ * allocated with a power of two capacity, so they only have to be copied when
+ * `n` is a power of two. The old array is left in the arena.
+ */
+static void *grow_array(void *array, size_t n, size_t size)
+{
+    void *res;
+
+    if (n & (n - 1))
+        return array;
+    res = arena_malloc(2 * n, size);
+    memcpy(res, array, n * size);
+    return res;
+}
+
+/*
+ * Check whether a word changes when it is expanded: it may refer to a variable,
+ * or has marked characters.
+ */
+static int word_expands(const char *word)
+{
+    return strchr(word, '$') != NULL || strchr(word, LITERAL_MARK) != NULL;
+}
+
+/* Remove the marks from a word in place, for words that are never expanded. */
+static void strip_marks(char *word)
+{
+    char *out = word;
+
+    for (; *word; word++) {
+        if (*word == LITERAL_MARK && word[1])
+            word++;
+        *out++ = *word;
+    }
+    *out = '\0';
+}
+
 node_t *make_redir(node_t *child, int fd, int mode, int fd2, char *target)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_malloc(1, sizeof(node_t));
     n->type = NODE_REDIRECT;
     n->redirect.child = child;
     n->redirect.fd = fd;
     n->redirect.mode = mode;
+    n->redirect.expand = 0;
     if (n->redirect.mode > 0) {
         assert(target != NULL);
         n->redirect.target = target;
+        if (mode == REDIRECT_HEREDOC)
+            strip_marks(target);
+        else
+            n->redirect.expand = word_expands(target);
     } else {
         n->redirect.fd2 = fd2;
     }
@@ -24,33 +68,59 @@ node_t *make_redir(node_t *child, int fd, int mode, int fd2, char *target)
 
 node_t *make_simple(char *prog)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_malloc(1, sizeof(node_t));
     n->type = NODE_COMMAND;
     n->command.program = prog;
-    n->command.argv = malloc(2 * sizeof(char *));
-    n->command.argv[0] = strdup(prog);
+    n->command.argv = arena_malloc(2, sizeof(char *));
+    n->command.argv[0] = prog;
     n->command.argv[1] = NULL;
     n->command.argc = 1;
+    n->command.expand = word_expands(prog);
+    n->command.substs = NULL;
+    n->command.n_substs = 0;
     return n;
 }
 
 node_t *extend_simple(node_t *cmd, char *extra)
 {
     assert(cmd->type == NODE_COMMAND);
-    cmd->command.argv = realloc(cmd->command.argv,
-                                 sizeof(char *) * (cmd->command.argc + 2));
+    cmd->command.argv = grow_array(cmd->command.argv, cmd->command.argc + 1,
+                                   sizeof(char *));
     cmd->command.argv[cmd->command.argc] = extra;
     cmd->command.argv[cmd->command.argc + 1] = NULL;
     cmd->command.argc++;
+    if (word_expands(extra))
+        cmd->command.expand = 1;
+    return cmd;
+}
+
+/*
+ * Add a process substitution, <(child) or >(child), as the next argument. The
+ * argument itself is "<(" or ">(" until the command runs.
+ */
+node_t *extend_substitution(node_t *cmd, int output, node_t *child)
+{
+    node_t **substs;
+
+    extend_simple(cmd, arena_strdup(output ? ">(" : "<("));
+    substs = arena_malloc(cmd->command.argc, sizeof(node_t *));
+    if (cmd->command.n_substs > 0)
+        memcpy(substs, cmd->command.substs, cmd->command.n_substs * sizeof(node_t *));
+    memset(substs + cmd->command.n_substs, 0,
+           (cmd->command.argc - cmd->command.n_substs) * sizeof(node_t *));
+    substs[cmd->command.argc - 1] = child;
+    cmd->command.substs = substs;
+    cmd->command.n_substs = cmd->command.argc;
+    cmd->command.expand = 1;
     return cmd;
 }
 
 node_t *make_pipe(node_t *first, node_t *second)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_malloc(1, sizeof(node_t));
     n->type = NODE_PIPE;
     n->pipe.n_parts = 2;
-    n->pipe.parts = malloc(2 * sizeof(node_t *));
+    n->pipe.parts = arena_malloc(2, sizeof(node_t *));
     n->pipe.parts[0] = first;
     n->pipe.parts[1] = second;
     return n;
@@ -59,15 +129,36 @@ node_t *make_pipe(node_t *first, node_t *second)
 node_t *extend_pipe(node_t *n, node_t *extra)
 {
     assert(n->type == NODE_PIPE);
-    n->pipe.parts = realloc(n->pipe.parts, sizeof(node_t *) * (n->pipe.n_parts + 1));
+    n->pipe.parts = grow_array(n->pipe.parts, n->pipe.n_parts, sizeof(node_t *));
     n->pipe.parts[n->pipe.n_parts] = extra;
     n->pipe.n_parts++;
     return n;
 }
 
+node_t *make_parallel(node_t *first, node_t *second)
+{
+    node_t *n = arena_malloc(1, sizeof(node_t));
+    n->type = NODE_PARALLEL;
+    n->parallel.n_parts = 2;
+    n->parallel.parts = arena_malloc(2, sizeof(node_t *));
+    n->parallel.parts[0] = first;
+    n->parallel.parts[1] = second;
+    return n;
+}
+
+node_t *extend_parallel(node_t *n, node_t *extra)
+{
+    assert(n->type == NODE_PARALLEL);
+    n->parallel.parts = grow_array(n->parallel.parts, n->parallel.n_parts,
+                                   sizeof(node_t *));
+    n->parallel.parts[n->parallel.n_parts] = extra;
+    n->parallel.n_parts++;
+    return n;
+}
+
 node_t *make_subshell(node_t *child)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_malloc(1, sizeof(node_t));
     n->type = NODE_SUBSHELL;
     n->subshell.child = child;
     return n;
@@ -75,7 +166,7 @@ node_t *make_subshell(node_t *child)
 
 node_t *make_detach(node_t *child)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_malloc(1, sizeof(node_t));
     n->type = NODE_DETACH;
     n->detach.child = child;
     return n;
@@ -83,13 +174,118 @@ node_t *make_detach(node_t *child)
 
 node_t *make_seq(node_t *left, node_t *right)
 {
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_malloc(1, sizeof(node_t));
     n->type = NODE_SEQUENCE;
     n->sequence.first = left;
     n->sequence.second = right;
     return n;
 }
 
+node_t *make_and_or(int type, node_t *left, node_t *right)
+{
+    node_t *n = arena_malloc(1, sizeof(node_t));
+    assert(type == NODE_AND || type == NODE_OR);
+    n->type = type;
+    n->and_or.first = left;
+    n->and_or.second = right;
+    return n;
+}
+/*
+ * Remove the first word of a simple command, and its entry in the array of
+ * process substitutions that runs parallel to the words.
+ */
+static void drop_word(node_t *cmd)
+{
+    cmd->command.argv++;
+    cmd->command.argc--;
+    cmd->command.program = cmd->command.argv[0];
+    if (cmd->command.n_substs > 0) {
+        cmd->command.substs++;
+        cmd->command.n_substs--;
+    }
+}
+
+node_t *make_timed(node_t *pipe)
+{
+    node_t *first = pipe->type == NODE_PIPE ? pipe->pipe.parts[0] : pipe;
+    node_t *n;
+    int posix;
+
+    if (first->type != NODE_COMMAND || first->command.argc < 2 ||
+        strcmp(first->command.program, "time") != 0)
+        return pipe;
+    posix = strcmp(first->command.argv[1], "-p") == 0;
+    if (posix && first->command.argc < 3)
+        return pipe;
+
+    drop_word(first);
+    if (posix)
+        drop_word(first);
+
+    n = arena_malloc(1, sizeof(node_t));
+    n->type = NODE_TIME;
+    n->time.child = pipe;
+    n->time.posix = posix;
+    return n;
+}
+
+/*
+ * Walk the tree in the order of the command line, counting down `index` for
+ * every here-document that is passed.
+ */
+static node_t *find_heredoc_rec(node_t *n, size_t *index)
+{
+    node_t *res = NULL;
+    size_t i;
+
+    switch(n->type) {
+    case NODE_COMMAND:
+        for (i = 0; i < n->command.n_substs && !res; ++i)
+            if (n->command.substs[i])
+                res = find_heredoc_rec(n->command.substs[i], index);
+        break;
+    case NODE_PIPE:
+        for (i = 0; i < n->pipe.n_parts && !res; ++i)
+            res = find_heredoc_rec(n->pipe.parts[i], index);
+        break;
+    case NODE_REDIRECT:
+        if (n->redirect.mode == REDIRECT_HEREDOC && (*index)-- == 0)
+            return n;
+        res = find_heredoc_rec(n->redirect.child, index);
+        break;
+    case NODE_SUBSHELL:
+        res = find_heredoc_rec(n->subshell.child, index);
+        break;
+    case NODE_DETACH:
+        res = find_heredoc_rec(n->detach.child, index);
+        break;
+    case NODE_SEQUENCE:
+        res = find_heredoc_rec(n->sequence.first, index);
+        if (!res)
+            res = find_heredoc_rec(n->sequence.second, index);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        res = find_heredoc_rec(n->and_or.first, index);
+        if (!res)
+            res = find_heredoc_rec(n->and_or.second, index);
+        break;
+    case NODE_TIME:
+        res = find_heredoc_rec(n->time.child, index);
+        break;
+    case NODE_PARALLEL:
+        for (i = 0; i < n->parallel.n_parts && !res; ++i)
+            res = find_heredoc_rec(n->parallel.parts[i], index);
+        break;
+    }
+    return res;
+}
+
+node_t *find_heredoc(node_t *root, size_t index)
+{
+    return find_heredoc_rec(root, &index);
+}
+
 
 void print_string(char *s)
 {
@@ -103,7 +299,14 @@ void print_string(char *s)
     if (escape) {
         putchar('"');
         for (size_t i = 0; s[i]; ++i)
-            if (s[i] == '\\' || s[i] == '"') {
+            if (s[i] == LITERAL_MARK && s[i + 1]) {
+                putchar('\\');
+                ++i;
+                if (s[i] == LITERAL_MARK)
+                    printf("x%02x", s[i]);
+                else
+                    putchar(s[i]);
+            } else if (s[i] == '\\' || s[i] == '"') {
                 putchar('\\');
                 putchar(s[i]);
             } else if (!isprint(s[i]))
@@ -130,7 +333,12 @@ void print_tree_flat(node_t *n, int nl)
         for (i = 0; i < n->command.argc; ++i) {
             if (i > 0)
                 putchar(' ');
-            print_string(n->command.argv[i]);
+            if (i < n->command.n_substs && n->command.substs[i]) {
+                printf("%s ", n->command.argv[i]);
+                print_tree_flat(n->command.substs[i], 0);
+                printf(" )");
+            } else
+                print_string(n->command.argv[i]);
         }
         break;
 
@@ -155,6 +363,8 @@ void print_tree_flat(node_t *n, int nl)
         case 1: printf("<");  print_string(n->redirect.target); break;
         case 2: printf(">");  print_string(n->redirect.target); break;
         case 3: printf(">>"); print_string(n->redirect.target); break;
+        case 4: printf("<<"); print_string(n->redirect.target); break;
+        case 5: printf("<<<"); print_string(n->redirect.target); break;
         }
 
         printf(" { ");
@@ -181,6 +391,33 @@ void print_tree_flat(node_t *n, int nl)
         print_tree_flat(n->sequence.second, 0);
         printf(" } ");
         break;
+
+    case NODE_AND:
+    case NODE_OR:
+        printf(" { ");
+        print_tree_flat(n->and_or.first, 0);
+        printf(n->type == NODE_AND ? " } && { " : " } || { ");
+        print_tree_flat(n->and_or.second, 0);
+        printf(" } ");
+        break;
+
+    case NODE_TIME:
+        printf(n->time.posix ? "time -p { " : "time { ");
+        print_tree_flat(n->time.child, 0);
+        printf(" } ");
+        break;
+
+    case NODE_PARALLEL:
+        printf(" { ");
+        for (i = 0; i < n->parallel.n_parts; ++i) {
+            if (i > 0)
+                printf(" ;; ");
+            printf(" { ");
+            print_tree_flat(n->parallel.parts[i], 0);
+            printf(" } ");
+        }
+        printf(" } ");
+        break;
     }
 
     if (nl)
@@ -212,9 +449,15 @@ static void print_tree_rec(node_t *n, int ind)
         for (i = 0; i < n->command.argc; ++i) {
             if (i > 0)
                 putchar(' ');
-            print_string(n->command.argv[i]);
+            if (i < n->command.n_substs && n->command.substs[i])
+                printf("%s...)", n->command.argv[i]);
+            else
+                print_string(n->command.argv[i]);
         }
         putchar('\n');
+        for (i = 0; i < n->command.n_substs; ++i)
+            if (n->command.substs[i])
+                print_tree_rec(n->command.substs[i], ind + 1);
         break;
 
     case NODE_PIPE:
@@ -237,6 +480,8 @@ static void print_tree_rec(node_t *n, int ind)
         case REDIRECT_INPUT:  printf("<"); print_string(n->redirect.target); break;
         case REDIRECT_OUTPUT: printf(">"); print_string(n->redirect.target); break;
         case REDIRECT_APPEND: printf(">>"); print_string(n->redirect.target); break;
+        case REDIRECT_HEREDOC: printf("<<"); print_string(n->redirect.target); break;
+        case REDIRECT_HERESTRING: printf("<<<"); print_string(n->redirect.target); break;
         }
         putchar('\n');
         print_tree_rec(n->redirect.child, ind + 1);
@@ -257,54 +502,29 @@ static void print_tree_rec(node_t *n, int ind)
         print_tree_rec(n->sequence.first, ind + 1);
         print_tree_rec(n->sequence.second, ind + 1);
         break;
-    }
-}
-
-
-void print_tree(node_t *node)
-{
-    print_tree_rec(node, 0);
-}
-
-void free_tree(node_t *n)
-{
-    size_t i;
-
-    if (!n)
-        return;
-
-    switch(n->type) {
-    case NODE_COMMAND:
-        free(n->command.program);
-        for (i = 0; i < n->command.argc; ++i)
-            free(n->command.argv[i]);
-        free(n->command.argv);
-        break;
 
-    case NODE_PIPE:
-        for (i = 0; i < n->pipe.n_parts; ++i)
-            free_tree(n->pipe.parts[i]);
-        free(n->pipe.parts);
+    case NODE_AND:
+    case NODE_OR:
+        printf(n->type == NODE_AND ? "AND\n" : "OR\n");
+        print_tree_rec(n->and_or.first, ind + 1);
+        print_tree_rec(n->and_or.second, ind + 1);
         break;
 
-    case NODE_REDIRECT:
-        if (n->redirect.mode > 0)
-            free(n->redirect.target);
-        free_tree(n->redirect.child);
+    case NODE_TIME:
+        printf(n->time.posix ? "TIME -p\n" : "TIME\n");
+        print_tree_rec(n->time.child, ind + 1);
         break;
 
-    case NODE_SUBSHELL:
-        free_tree(n->subshell.child);
+    case NODE_PARALLEL:
+        printf("PARALLEL\n");
+        for (i = 0; i < n->parallel.n_parts; ++i)
+            print_tree_rec(n->parallel.parts[i], ind + 1);
         break;
+    }
+}
 
-    case NODE_DETACH:
-        free_tree(n->detach.child);
-        break;
 
-    case NODE_SEQUENCE:
-        free_tree(n->sequence.first);
-        free_tree(n->sequence.second);
-        break;
-    }
-    free(n);
+void print_tree(node_t *node)
+{
+    print_tree_rec(node, 0);
 }
@@ -10,7 +10,11 @@ enum node_type
     NODE_REDIRECT,
     NODE_SUBSHELL,
     NODE_SEQUENCE,
-    NODE_DETACH
+    NODE_DETACH,
+    NODE_AND, // &&
+    NODE_OR,  // ||
+    NODE_TIME, // time keyword
+    NODE_PARALLEL // { a ;; b }
 };
 
 enum redirect_type
@@ -18,9 +22,18 @@ enum redirect_type
     REDIRECT_DUP = 0, // >&
     REDIRECT_INPUT,   // <
     REDIRECT_OUTPUT,  // >
-    REDIRECT_APPEND   // >>
+    REDIRECT_APPEND,  // >>
+    REDIRECT_HEREDOC, // <<WORD, the target is the body of the here-document
+    REDIRECT_HERESTRING // <<<WORD
 };
 
+/*
+ * Precedes a character of a word that was escaped or single-quoted, and so
+ * must not be expanded: a '$', or a LITERAL_MARK that was in the input itself.
+ * Expansion removes the marks.
+ */
+#define LITERAL_MARK '\x01'
+
 struct tree_node;
 typedef struct tree_node node_t;
 
@@ -33,6 +46,9 @@ struct tree_node
             char *program;
             char **argv;
             size_t argc;
+            int expand; // non-zero if an argument has '$' or a mark, or is a process substitution
+            node_t **substs; // array parallel to argv: the command of a process substitution
+            size_t n_substs; // the entries of substs, the arguments after them are plain words
         } command;
 
         struct {
@@ -44,6 +60,7 @@ struct tree_node
             node_t *child;
             int fd; // >= 0 specific fd; -1 stdout+stderr
             enum redirect_type mode;
+            int expand; // non-zero for a file name or here-string with '$' or a mark
             union {
                 int fd2;
                 char *target;
@@ -62,14 +79,24 @@ struct tree_node
             node_t *first;
             node_t *second;
         } sequence;
+
+        struct {
+            node_t *first;
+            node_t *second; // only run depending on the exit status of first
+        } and_or;
+
+        struct {
+            node_t *child;
+            int posix; // time -p: only the totals, in the format of POSIX
+        } time;
+
+        struct {
+            node_t **parts; // array, run concurrently
+            size_t n_parts;
+        } parallel;
     };
 };
 
-/*
- * This function de-allocates a command tree.
- */
-void free_tree(node_t *root);
-
 /*
  * This function prints a command tree on the standard output using a
  * tree structure.
@@ -82,14 +109,36 @@ void print_tree(node_t *root);
  */
 void print_tree_flat(node_t *root, int print_final_newline);
 
-/* Node constructors */
+/*
+ * Node constructors. Nodes, and the arrays they point to, are allocated in the
+ * current arena, so a whole tree is freed at once by popping that arena. The
+ * strings passed to the constructors must live at least as long as the tree.
+ */
 node_t *make_detach(node_t *child);
 node_t *make_simple(char *prog);
 node_t *extend_simple(node_t *cmd, char *arg);
+node_t *extend_substitution(node_t *cmd, int output, node_t *child);
 node_t *make_seq(node_t *left, node_t *right);
+node_t *make_and_or(int type, node_t *left, node_t *right);
 node_t *make_pipe(node_t *first, node_t *second);
 node_t *extend_pipe(node_t *pipe, node_t *extra);
+node_t *make_parallel(node_t *first, node_t *second);
+node_t *extend_parallel(node_t *parallel, node_t *extra);
 node_t *make_subshell(node_t *child);
 node_t *make_redir(node_t *child, int fd, int mode, int fd2, char *target);
 
+/*
+ * If the pipeline `pipe` starts with the word "time" followed by a command,
+ * the word, and a -p option after it, is removed and the pipeline is wrapped
+ * in a time node. Otherwise the pipeline is returned as is.
+ */
+node_t *make_timed(node_t *pipe);
+
+/*
+ * Find the here-document with number `index` (counting from 0) in the order
+ * they appear in the command line, or NULL if there are fewer. Until its body
+ * has been read, the target of a here-document is its delimiter.
+ */
+node_t *find_heredoc(node_t *root, size_t index);
+
 #endif
@@ -7,7 +7,18 @@ struct lex_token {
     char *text;
     int number;
 };
+/*
+ * The text of the last NUMBER or WORD token. It is `token_len` bytes long and
+ * not terminated: it may point into the buffer that is being scanned.
+ */
 extern char *token_text;
+extern size_t token_len;
+
+/*
+ * Let the lexer scan `len` bytes at `buf` in place. Both buf[len] and
+ * buf[len + 1] must be 0.
+ */
+void lexer_scan_line(char *buf, size_t len);
 
 void *ParseAlloc(void * (*)(size_t));
 void ParseFree(void *, void (*)(void *));
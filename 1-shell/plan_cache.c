@@ -0,0 +1,324 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the plan cache of the shell. Scripts often run the same command line over and
+ * over, e.g. in a loop that feeds lines to the shell. Instead of lexing and parsing such a line
+ * again every time, the parsed tree is kept as a plan: a copy of the tree in one block of memory,
+ * which is run directly when the same line is seen again.
+ */
+
+#include "plan_cache.h"
+#include "parser/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The number of slots in the cache, a line can only be stored in the slot its hash maps to.
+#define PLAN_SLOTS 256
+
+// Longer lines are not cached: they are rarely repeated and would take a lot of memory.
+#define MAX_PLAN_LINE 4096
+
+/* A cached plan. The nodes and their arrays follow the header in the same block, followed by all
+ * strings, including the line itself.
+ */
+struct plan {
+    unsigned long hash;
+    size_t len;
+    const char *line;
+    long parse_ns;
+    node_t *root;
+};
+
+/* Where the next node or array and the next string of a plan are copied to. */
+struct plan_cursor {
+    char *obj;
+    char *str;
+};
+
+int use_plan_cache = 1;
+
+static struct plan *slots[PLAN_SLOTS];
+static size_t n_plans = 0;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static long long saved_ns = 0;
+static int running = 0;
+static int clear_pending = 0;
+
+/* Compute the hash of a command line using the djb2 string hash.
+ *
+ * line: the command line
+ * len: the length of the line
+ *
+ * Returns:
+ * the hash of the line
+ */
+static unsigned long hash_line(const char *line, size_t len) {
+    unsigned long hash = 5381;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = hash * 33 + (unsigned char)line[i];
+    }
+
+    return hash;
+}
+
+/* Compute the memory needed for a copy of a tree.
+ *
+ * All nodes and arrays of pointers have a size that is a multiple of the size of a pointer, so they
+ * can be stored one after the other without padding.
+ *
+ * node: the root of the tree
+ * objs: increased by the size of the nodes and arrays
+ * strs: increased by the size of the strings
+ */
+static void measure_tree(const node_t *node, size_t *objs, size_t *strs) {
+    *objs += sizeof(node_t);
+
+    switch (node->type) {
+    case NODE_COMMAND:
+        *objs += (node->command.argc + 1) * sizeof(char *);
+        for (size_t i = 0; i < node->command.argc; i++) {
+            *strs += strlen(node->command.argv[i]) + 1;
+        }
+        *objs += node->command.n_substs * sizeof(node_t *);
+        for (size_t i = 0; i < node->command.n_substs; i++) {
+            if (node->command.substs[i] != NULL) {
+                measure_tree(node->command.substs[i], objs, strs);
+            }
+        }
+        break;
+    case NODE_PIPE:
+        *objs += node->pipe.n_parts * sizeof(node_t *);
+        for (size_t i = 0; i < node->pipe.n_parts; i++) {
+            measure_tree(node->pipe.parts[i], objs, strs);
+        }
+        break;
+    case NODE_REDIRECT:
+        if (node->redirect.mode != REDIRECT_DUP) {
+            *strs += strlen(node->redirect.target) + 1;
+        }
+        measure_tree(node->redirect.child, objs, strs);
+        break;
+    case NODE_SUBSHELL:
+        measure_tree(node->subshell.child, objs, strs);
+        break;
+    case NODE_DETACH:
+        measure_tree(node->detach.child, objs, strs);
+        break;
+    case NODE_SEQUENCE:
+        measure_tree(node->sequence.first, objs, strs);
+        measure_tree(node->sequence.second, objs, strs);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        measure_tree(node->and_or.first, objs, strs);
+        measure_tree(node->and_or.second, objs, strs);
+        break;
+    case NODE_TIME:
+        measure_tree(node->time.child, objs, strs);
+        break;
+    case NODE_PARALLEL:
+        *objs += node->parallel.n_parts * sizeof(node_t *);
+        for (size_t i = 0; i < node->parallel.n_parts; i++) {
+            measure_tree(node->parallel.parts[i], objs, strs);
+        }
+        break;
+    }
+}
+
+/* Take memory for a node or array from a plan.
+ *
+ * cursor: the cursor of the plan
+ * size: the size of the node or array
+ *
+ * Returns:
+ * the memory
+ */
+static void *take_obj(struct plan_cursor *cursor, size_t size) {
+    void *res = cursor->obj;
+    cursor->obj += size;
+    return res;
+}
+
+/* Copy a string into a plan.
+ *
+ * cursor: the cursor of the plan
+ * s: the string
+ *
+ * Returns:
+ * the copy
+ */
+static char *copy_string(struct plan_cursor *cursor, const char *s) {
+    size_t size = strlen(s) + 1;
+    char *res = cursor->str;
+
+    memcpy(res, s, size);
+    cursor->str += size;
+    return res;
+}
+
+/* Copy a tree into a plan. The memory must have been measured with measure_tree.
+ *
+ * node: the root of the tree
+ * cursor: the cursor of the plan
+ *
+ * Returns:
+ * the root of the copy
+ */
+static node_t *copy_tree(const node_t *node, struct plan_cursor *cursor) {
+    node_t *copy = take_obj(cursor, sizeof(node_t));
+
+    *copy = *node;
+    switch (node->type) {
+    case NODE_COMMAND:
+        copy->command.argv = take_obj(cursor, (node->command.argc + 1) * sizeof(char *));
+        for (size_t i = 0; i < node->command.argc; i++) {
+            copy->command.argv[i] = copy_string(cursor, node->command.argv[i]);
+        }
+        copy->command.argv[node->command.argc] = NULL;
+        copy->command.program = copy->command.argv[0];
+        if (node->command.n_substs > 0) {
+            copy->command.substs = take_obj(cursor, node->command.n_substs * sizeof(node_t *));
+            for (size_t i = 0; i < node->command.n_substs; i++) {
+                copy->command.substs[i] = node->command.substs[i] == NULL
+                                              ? NULL
+                                              : copy_tree(node->command.substs[i], cursor);
+            }
+        }
+        break;
+    case NODE_PIPE:
+        copy->pipe.parts = take_obj(cursor, node->pipe.n_parts * sizeof(node_t *));
+        for (size_t i = 0; i < node->pipe.n_parts; i++) {
+            copy->pipe.parts[i] = copy_tree(node->pipe.parts[i], cursor);
+        }
+        break;
+    case NODE_REDIRECT:
+        if (node->redirect.mode != REDIRECT_DUP) {
+            copy->redirect.target = copy_string(cursor, node->redirect.target);
+        }
+        copy->redirect.child = copy_tree(node->redirect.child, cursor);
+        break;
+    case NODE_SUBSHELL:
+        copy->subshell.child = copy_tree(node->subshell.child, cursor);
+        break;
+    case NODE_DETACH:
+        copy->detach.child = copy_tree(node->detach.child, cursor);
+        break;
+    case NODE_SEQUENCE:
+        copy->sequence.first = copy_tree(node->sequence.first, cursor);
+        copy->sequence.second = copy_tree(node->sequence.second, cursor);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        copy->and_or.first = copy_tree(node->and_or.first, cursor);
+        copy->and_or.second = copy_tree(node->and_or.second, cursor);
+        break;
+    case NODE_TIME:
+        copy->time.child = copy_tree(node->time.child, cursor);
+        break;
+    case NODE_PARALLEL:
+        copy->parallel.parts = take_obj(cursor, node->parallel.n_parts * sizeof(node_t *));
+        for (size_t i = 0; i < node->parallel.n_parts; i++) {
+            copy->parallel.parts[i] = copy_tree(node->parallel.parts[i], cursor);
+        }
+        break;
+    }
+
+    return copy;
+}
+
+node_t *plan_cache_lookup(const char *line, size_t len) {
+    if (!use_plan_cache || len > MAX_PLAN_LINE) {
+        return NULL;
+    }
+
+    unsigned long hash = hash_line(line, len);
+    struct plan *plan = slots[hash % PLAN_SLOTS];
+
+    if (plan == NULL || plan->hash != hash || plan->len != len ||
+        memcmp(plan->line, line, len) != 0) {
+        misses++;
+        return NULL;
+    }
+
+    hits++;
+    saved_ns += plan->parse_ns;
+    return plan->root;
+}
+
+node_t *plan_cache_insert(const char *line, size_t len, node_t *root, long parse_ns) {
+    // A plan can not be replaced while it is running, but plans are only inserted between lines.
+    if (!use_plan_cache || len > MAX_PLAN_LINE || running) {
+        return root;
+    }
+
+    size_t objs = sizeof(struct plan);
+    size_t strs = len + 1;
+    measure_tree(root, &objs, &strs);
+
+    struct plan *plan = malloc(objs + strs);
+    if (plan == NULL) {
+        perror("malloc");
+        return root;
+    }
+
+    struct plan_cursor cursor = {(char *)(plan + 1), (char *)plan + objs};
+    char *copy = cursor.str;
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    cursor.str += len + 1;
+
+    plan->hash = hash_line(line, len);
+    plan->len = len;
+    plan->line = copy;
+    plan->parse_ns = parse_ns;
+    plan->root = copy_tree(root, &cursor);
+
+    struct plan **slot = &slots[plan->hash % PLAN_SLOTS];
+    if (*slot != NULL) {
+        free(*slot);
+        n_plans--;
+    }
+    *slot = plan;
+    n_plans++;
+
+    return plan->root;
+}
+
+void plan_cache_begin(void) { running++; }
+
+void plan_cache_end(void) {
+    running--;
+    if (running == 0 && clear_pending) {
+        clear_pending = 0;
+        plan_cache_free();
+    }
+}
+
+void plan_cache_clear(void) {
+    if (running) {
+        clear_pending = 1;
+    } else {
+        plan_cache_free();
+    }
+}
+
+void plan_cache_free(void) {
+    for (size_t i = 0; i < PLAN_SLOTS; i++) {
+        free(slots[i]);
+        slots[i] = NULL;
+    }
+    n_plans = 0;
+}
+
+void plan_cache_print(void) {
+    unsigned long lookups = hits + misses;
+
+    printf("plans: %zu cached, %lu hits, %lu misses (%.1f%% hit rate)\n", n_plans, hits, misses,
+           lookups == 0 ? 0.0 : 100.0 * hits / lookups);
+    printf("plans: %.3f ms parse time saved\n", saved_ns / 1e6);
+}
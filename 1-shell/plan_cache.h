@@ -0,0 +1,57 @@
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+#include <stddef.h>
+
+struct tree_node;
+
+/*
+ * When zero, no line is cached, so every line is lexed and parsed. Cleared by
+ * the -p command-line option.
+ */
+extern int use_plan_cache;
+
+/*
+ * Look up the plan of the command line `line` of `len` bytes. A plan is a
+ * copy of the parsed tree of the line, stored in a single block of memory.
+ *
+ * Returns the root of the plan, or NULL if the line has not been cached. The
+ * plan must not be modified.
+ */
+struct tree_node *plan_cache_lookup(const char *line, size_t len);
+
+/*
+ * Store a copy of the tree `root` as the plan of `line`. `parse_ns` is the
+ * time it took to lex and parse the line, which is saved on every hit.
+ *
+ * Returns the root of the plan, or `root` itself if the line is too long to
+ * be cached or the cache is not used.
+ */
+struct tree_node *plan_cache_insert(const char *line, size_t len,
+                                    struct tree_node *root, long parse_ns);
+
+/*
+ * Must be called around running a plan, so the plan is not freed while it is
+ * being run, e.g. by "plans -r".
+ */
+void plan_cache_begin(void);
+void plan_cache_end(void);
+
+/*
+ * Remove all plans from the cache. If a plan is running, they are removed
+ * once it has finished.
+ */
+void plan_cache_clear(void);
+
+/*
+ * Free all plans, also when one is running. Only to be used on exit.
+ */
+void plan_cache_free(void);
+
+/*
+ * Print the number of cached plans, the hit rate and the parse time saved on
+ * the standard output.
+ */
+void plan_cache_print(void);
+
+#endif
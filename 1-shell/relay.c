@@ -0,0 +1,79 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the data mover of the relay builtin. A relay stage in a pipeline runs inside
+ * the shell itself, so the data it forwards should cost as little as possible: when one side is a
+ * pipe, splice() lets the kernel move the pages from one file descriptor to the other without
+ * copying them to user space. Anything splice() does not support (e.g. a terminal on both sides)
+ * falls back to a plain read/write loop.
+ */
+
+#define _GNU_SOURCE
+
+#include "relay.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The most data moved with a single splice() call. Larger than a pipe buffer, so a call is only
+// limited by what the pipe holds.
+#define SPLICE_CHUNK (1 << 20)
+
+// The size of the buffer used when splice() can not be used.
+#define COPY_BUFFER (1 << 16)
+
+/* Copy data using read() and write().
+ *
+ * in_fd: the file descriptor to read from
+ * out_fd: the file descriptor to write to
+ *
+ * Returns:
+ * 0 on success, -1 on failure
+ */
+static int copy_fd(int in_fd, int out_fd) {
+    char buf[COPY_BUFFER];
+
+    for (;;) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n == 0) {
+            return 0;
+        } else if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        for (ssize_t done = 0; done < n;) {
+            ssize_t written = write(out_fd, buf + done, n - done);
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            done += written;
+        }
+    }
+}
+
+int relay(int in_fd, int out_fd) {
+    for (;;) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0) {
+            return 0;
+        } else if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Neither side is a pipe, or one side does not support splicing at all. Nothing has
+            // been moved yet by this call, so the rest can simply be copied.
+            if (errno == EINVAL) {
+                return copy_fd(in_fd, out_fd);
+            }
+            return -1;
+        }
+    }
+}
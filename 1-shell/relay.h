@@ -0,0 +1,14 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+/*
+ * Copy everything that can be read from `in_fd` to `out_fd`, until end of
+ * file. The data is moved with splice(2) when one of the two is a pipe, so it
+ * never passes through the memory of the shell; otherwise it is copied with
+ * read(2) and write(2).
+ *
+ * Returns 0 on success, or -1 with errno set if reading or writing failed.
+ */
+int relay(int in_fd, int out_fd);
+
+#endif
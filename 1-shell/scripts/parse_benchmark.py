@@ -0,0 +1,68 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that measures how many lines per second 42sh can parse. It generates a
+large script with a mix of simple commands, pipelines, redirects and quoted arguments, and runs it
+with the -n option, so the commands are parsed but not run. Pass the paths of multiple builds of
+42sh to compare them.
+
+Run it from the 1-shell directory after building 42sh:
+python3 scripts/parse_benchmark.py [LINES] [SHELL...]
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+REPEATS = 3
+LINES = [
+    'ls -alh /usr/bin',
+    'cat file.txt | grep -v "^#" | sort | uniq -c | sort -rn | head -n 10',
+    '>out.txt 2>&1 make -j8 all',
+    'echo "a quoted argument with spaces" \\x41\\x42 escaped\\ space',
+    '{ cd /tmp; ls; } | wc -l',
+    '(set PATH=/bin; find . -name "*.c") &',
+]
+
+
+def write_script(n):
+    fd, path = tempfile.mkstemp(suffix='.sh')
+    with os.fdopen(fd, 'w') as f:
+        for i in range(n):
+            f.write(LINES[i % len(LINES)] + '\n')
+    return path
+
+
+def run_script(shell, path):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    best = None
+    for _ in range(REPEATS):
+        start = time.perf_counter()
+        subprocess.run([shell, '-n', path], stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    shells = sys.argv[2:] or ['./42sh']
+
+    path = write_script(n)
+    try:
+        print(f"Shell                          | Lines    | Time (s) | Lines/s")
+        print("-" * 70)
+        for shell in shells:
+            elapsed = run_script(shell, path)
+            print(f"{shell:<30} | {n:>8} | {elapsed:>8.3f} | {n / elapsed:>10.0f}")
+    finally:
+        os.unlink(path)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,66 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that measures how the time to run a pipeline grows with the number of
+stages. It generates scripts with N-stage pipelines of the form "echo x | cat | cat | ... | cat",
+runs them with 42sh using both the spawn backend (the default) and fork (the -f option) and prints
+the time per pipeline and per stage in a table format. Pipeline setup is linear in the number of
+stages, so the time per stage should stay roughly the same for wide pipelines.
+
+Run it from the 1-shell directory after building 42sh: python3 scripts/pipeline_benchmark.py
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+SHELL = './42sh'
+REPEATS = 3
+STAGES = [2, 10, 50, 100, 200]
+
+
+def write_script(stages, n):
+    line = ' | '.join(['echo x'] + ['cat'] * (stages - 1))
+    fd, path = tempfile.mkstemp(suffix='.sh')
+    with os.fdopen(fd, 'w') as f:
+        f.write((line + '\n') * n)
+    return path
+
+
+def run_script(path, flags):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    best = None
+    for _ in range(REPEATS):
+        start = time.perf_counter()
+        subprocess.run([SHELL] + flags + [path], stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+
+    print(f"Stages | Pipelines | fork ms/pipe | fork us/stage | spawn ms/pipe | spawn us/stage")
+    print("-" * 83)
+
+    for stages in STAGES:
+        path = write_script(stages, n)
+        try:
+            fork_time = run_script(path, ['-f'])
+            spawn_time = run_script(path, [])
+        finally:
+            os.unlink(path)
+
+        print(f"{stages:>6} | {n:>9} | {fork_time / n * 1e3:>12.2f} | "
+              f"{fork_time / (n * stages) * 1e6:>13.1f} | {spawn_time / n * 1e3:>13.2f} | "
+              f"{spawn_time / (n * stages) * 1e6:>14.1f}")
+
+
+if __name__ == '__main__':
+    main()
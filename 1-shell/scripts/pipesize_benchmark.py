@@ -0,0 +1,68 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that measures the effect of the pipe size on a high-throughput
+pipeline. It runs "head -c SIZE /dev/zero | cat | cat | wc -c" with 42sh for several values of
+$PIPESIZE and prints the throughput and the number of context switches of all processes of the
+pipeline in a table format.
+
+Run it from the 1-shell directory after building 42sh: python3 scripts/pipesize_benchmark.py [GiB]
+"""
+
+import os
+import resource
+import subprocess
+import sys
+import time
+
+SHELL = './42sh'
+REPEATS = 3
+PIPE_SIZES = ['', '16k', '64k', '256k', '1m']
+
+
+def context_switches():
+    rusage = resource.getrusage(resource.RUSAGE_CHILDREN)
+    return rusage.ru_nvcsw + rusage.ru_nivcsw
+
+
+def run_pipeline(pipe_size, size):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    line = f'head -c {size} /dev/zero | cat | cat | wc -c'
+    env = dict(os.environ)
+    env.pop('PIPESIZE', None)
+    if pipe_size:
+        env['PIPESIZE'] = pipe_size
+
+    best = None
+    for _ in range(REPEATS):
+        start_switches = context_switches()
+        start = time.perf_counter()
+        res = subprocess.run([SHELL, '-c', line], stdout=subprocess.PIPE, check=True, text=True,
+                             env=env)
+        elapsed = time.perf_counter() - start
+        switches = context_switches() - start_switches
+        if int(res.stdout) != size:
+            sys.exit(f'PIPESIZE={pipe_size}: expected {size} bytes, got {res.stdout.strip()}')
+        if best is None or elapsed < best[0]:
+            best = (elapsed, switches)
+    return best
+
+
+def main():
+    gib = float(sys.argv[1]) if len(sys.argv) > 1 else 2
+    size = int(gib * (1 << 30))
+
+    print(f"PIPESIZE | Size (GiB) | Time (s) | Throughput (GiB/s) | Context switches")
+    print("-" * 71)
+
+    for pipe_size in PIPE_SIZES:
+        elapsed, switches = run_pipeline(pipe_size, size)
+        print(f"{pipe_size or 'default':<8} | {gib:>10.2f} | {elapsed:>8.3f} | "
+              f"{gib / elapsed:>18.2f} | {switches:>16}")
+
+
+if __name__ == '__main__':
+    main()
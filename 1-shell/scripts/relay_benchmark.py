@@ -0,0 +1,66 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that measures the throughput of a pipeline stage that forwards a large
+stream of data. It runs "head -c SIZE /dev/zero | STAGE | wc -c" with 42sh for three kinds of
+stages: the relay builtin running inside the shell, the relay builtin in a forked subshell and the
+external cat program. Next to the wall-clock time it reports the CPU time (user + system) used by
+all processes of the pipeline, which is where moving the data with splice() instead of copying it
+shows up. The results are printed in a table format.
+
+Run it from the 1-shell directory after building 42sh: python3 scripts/relay_benchmark.py [GiB]
+"""
+
+import resource
+import subprocess
+import sys
+import time
+
+SHELL = './42sh'
+REPEATS = 3
+STAGES = {
+    'relay': 'relay',
+    '(relay)': '(relay)',
+    'cat': 'cat',
+}
+
+
+def cpu_time():
+    usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+    return usage.ru_utime + usage.ru_stime
+
+
+def run_pipeline(stage, size):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    line = f'head -c {size} /dev/zero | {stage} | wc -c'
+    best = None
+    for _ in range(REPEATS):
+        start_cpu = cpu_time()
+        start = time.perf_counter()
+        res = subprocess.run([SHELL, '-c', line], stdout=subprocess.PIPE, check=True, text=True)
+        elapsed = time.perf_counter() - start
+        cpu = cpu_time() - start_cpu
+        if int(res.stdout) != size:
+            sys.exit(f'{stage}: expected {size} bytes, got {res.stdout.strip()}')
+        if best is None or elapsed < best[0]:
+            best = (elapsed, cpu)
+    return best
+
+
+def main():
+    gib = float(sys.argv[1]) if len(sys.argv) > 1 else 2
+    size = int(gib * (1 << 30))
+
+    print(f"Stage    | Size (GiB) | Time (s) | CPU (s) | Throughput (GiB/s)")
+    print("-" * 62)
+
+    for name, stage in STAGES.items():
+        elapsed, cpu = run_pipeline(stage, size)
+        print(f"{name:<8} | {gib:>10.2f} | {elapsed:>8.3f} | {cpu:>7.3f} | {gib / elapsed:>18.2f}")
+
+
+if __name__ == '__main__':
+    main()
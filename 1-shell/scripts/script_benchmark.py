@@ -0,0 +1,69 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that compares the time 42sh needs to run a large generated script when
+the script is passed as a FILE argument (read in blocks by the shell itself) and when it is fed on
+stdin (read line by line with readline). Both a parse-only run (-n) and a run that executes cheap
+builtins are timed, and the results are printed in a table format.
+
+Run it from the 1-shell directory after building 42sh: python3 scripts/script_benchmark.py [LINES]
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+SHELL = './42sh'
+REPEATS = 3
+WORKLOADS = {
+    'parse only': (['-n'], 'cat file.txt | grep -v "^#" | sort | uniq -c | head -n 10'),
+    'builtins': ([], 'cd .'),
+}
+
+
+def write_script(line, n):
+    fd, path = tempfile.mkstemp(suffix='.sh')
+    with os.fdopen(fd, 'w') as f:
+        f.write((line + '\n') * n)
+    return path
+
+
+def run(args, stdin_path=None):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    best = None
+    for _ in range(REPEATS):
+        stdin = open(stdin_path) if stdin_path else subprocess.DEVNULL
+        start = time.perf_counter()
+        subprocess.run([SHELL] + args, stdin=stdin, stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        if stdin_path:
+            stdin.close()
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+
+    print(f"Workload   | Lines    | readline (s) | FILE (s) | Speedup")
+    print("-" * 60)
+
+    for name, (flags, line) in WORKLOADS.items():
+        path = write_script(line, n)
+        try:
+            readline_time = run(flags, stdin_path=path)
+            file_time = run(flags + [path])
+        finally:
+            os.unlink(path)
+
+        print(f"{name:<10} | {n:>8} | {readline_time:>12.3f} | {file_time:>8.3f} | "
+              f"{readline_time / file_time:>6.1f}x")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,69 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that compares the number of commands per second 42sh can run when
+external commands are started with posix_spawn (the default) and with fork + execvp (the -f
+option). It generates a script with many short commands and pipelines, runs it with both backends
+and prints the results in a table format.
+
+Run it from the 1-shell directory after building 42sh: python3 scripts/spawn_benchmark.py
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+SHELL = './42sh'
+REPEATS = 3
+WORKLOADS = {
+    'simple': 'true',
+    'arguments': 'true a b c d e f g h',
+    'pipeline': 'true | true | true',
+}
+
+
+def write_script(line, n):
+    fd, path = tempfile.mkstemp(suffix='.sh')
+    with os.fdopen(fd, 'w') as f:
+        f.write((line + '\n') * n)
+    return path
+
+
+def run_script(path, flags):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    best = None
+    for _ in range(REPEATS):
+        start = time.perf_counter()
+        subprocess.run([SHELL] + flags + [path], stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+
+    print(f"Workload  | Commands | fork cmd/s | spawn cmd/s | Speedup")
+    print("-" * 60)
+
+    for name, line in WORKLOADS.items():
+        path = write_script(line, n)
+        try:
+            fork_time = run_script(path, ['-f'])
+            spawn_time = run_script(path, [])
+        finally:
+            os.unlink(path)
+
+        fork_rate = n / fork_time
+        spawn_rate = n / spawn_time
+        print(f"{name:<9} | {n:>8} | {fork_rate:>10.0f} | {spawn_rate:>11.0f} | "
+              f"{spawn_rate / fork_rate:>6.2f}x")
+
+
+if __name__ == '__main__':
+    main()
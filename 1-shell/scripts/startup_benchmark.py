@@ -0,0 +1,99 @@
+"""
+- Name: Daan Rosendal
+- Student number: 15229394
+- Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating Systems
+  as a "bijvak".
+
+This file contains a script that measures the startup time of 42sh and the overhead of every line
+in an interactive shell. The startup time is the time `42sh -c true` takes. The interactive shell
+runs on a pseudo terminal with a history file of a given size: the time until the first prompt is
+shown and the time per line (typing `true` and waiting for the next prompt) are measured. The
+results are printed in a table format.
+
+Run it from the 1-shell directory after building 42sh: python3 scripts/startup_benchmark.py [SHELL]
+"""
+
+import os
+import pty
+import select
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+REPEATS = 3
+STARTUP_RUNS = 200
+LINES = 200
+HISTORY_SIZES = [0, 10000, 100000]
+PROMPT = b'42sh$ '
+
+
+def best_of(measure):
+    # Take the best of a few runs to filter out noise from the rest of the system.
+    return min(measure() for _ in range(REPEATS))
+
+
+def startup(shell):
+    start = time.perf_counter()
+    for _ in range(STARTUP_RUNS):
+        subprocess.run([shell, '-c', 'true'], stdin=subprocess.DEVNULL, check=True)
+    return (time.perf_counter() - start) / STARTUP_RUNS
+
+
+def wait_for_prompt(fd):
+    out = b''
+    while not out.endswith(PROMPT):
+        select.select([fd], [], [])
+        out += os.read(fd, 4096)
+
+
+def interactive(shell, home):
+    pid, fd = pty.fork()
+    if pid == 0:
+        os.execve(shell, [shell], {'HOME': home, 'TERM': 'dumb', 'PATH': os.environ['PATH']})
+
+    start = time.perf_counter()
+    wait_for_prompt(fd)
+    first_prompt = time.perf_counter() - start
+
+    start = time.perf_counter()
+    for _ in range(LINES):
+        os.write(fd, b'true\n')
+        wait_for_prompt(fd)
+    per_line = (time.perf_counter() - start) / LINES
+
+    os.write(fd, b'exit\n')
+    os.waitpid(pid, 0)
+    os.close(fd)
+    return first_prompt, per_line
+
+
+def main():
+    shell = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else './42sh')
+
+    print(f"42sh -c true: {best_of(lambda: startup(shell)) * 1e3:.3f} ms")
+    print()
+    print(f"History lines | First prompt (ms) | Per line (ms)")
+    print("-" * 51)
+
+    for size in HISTORY_SIZES:
+        home = tempfile.mkdtemp()
+        try:
+            path = os.path.join(home, '.history')
+            times = []
+            for _ in range(REPEATS):
+                # Every run starts with the same history, as the shell appends to it.
+                with open(path, 'w') as f:
+                    f.write(''.join(f'echo history line {i}\n' for i in range(size)))
+                times.append(interactive(shell, home))
+        finally:
+            shutil.rmtree(home)
+
+        first_prompt = min(t[0] for t in times)
+        per_line = min(t[1] for t in times)
+        print(f"{size:>13} | {first_prompt * 1e3:>17.3f} | {per_line * 1e3:>13.3f}")
+
+
+if __name__ == '__main__':
+    main()
@@ -6,29 +6,67 @@
  * This file contains the implementation of the shell. The shell is an interactive command-line
  * interpreter that can execute commands. The shell supports the following functionalities:
  * - External commands
- * - Built-in commands: exit, cd
- * - Sequences
- * - Pipes
+ * - Built-in commands: exit, cd, set, export, unset, hash, plans, jobs, fg, bg, wait, relay
+ * - Sequences, and sequences that depend on the exit status of a command (&& and ||)
+ * - Parallel groups: { a ;; b ;; c } runs a, b and c concurrently, at most $PARALLEL at a time
+ * - Pipes, where builtins like relay run inside the shell instead of in a forked copy
  * - Redirects
  * - Detached commands
+ * - Job control: Ctrl+Z and the jobs, fg, bg and wait built-ins
  * - Subshells
- * - Environment variables (using set and unset)
+ * - Variables: local (NAME=value) and exported (using set and export), removed using unset
+ * - Expansion of $NAME, ${NAME} and the exit status of the last command ($?)
+ * - A command hash that caches $PATH lookups (inspected and cleared using hash)
+ * - A plan cache that keeps the parsed tree of repeated command lines (inspected and cleared using
+ *   plans)
+ * - The time keyword, and per-process resource accounting (when $ACCOUNTING names a log file)
+ * - An execution trace of all commands and processes (enabled using -t)
  */
 
-#define _POSIX_C_SOURCE 200112L
+#define _GNU_SOURCE
 
 #include "shell.h"
 #include "arena.h"
+#include "bench.h"
+#include "command_hash.h"
 #include "front.h"
+#include "jobs.h"
 #include "parser/ast.h"
+#include "plan_cache.h"
+#include "relay.h"
+#include "spawn.h"
+#include "trace.h"
+#include "vars.h"
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
+/* How a builtin runs as a stage of a pipeline. */
+enum builtin_stage {
+    STAGE_FORK,   // in a forked copy of the shell, like every command that is not external
+    STAGE_INLINE, // inside the shell itself, with stdin and stdout redirected to the pipes; only
+                  // for builtins that do not change the state of the shell
+    STAGE_NOOP,   // not at all: it only changes the state of the shell, which a stage can not do
+};
+
+// Defined below, together with the table of builtin commands.
+int is_builtin(const char *program);
+enum builtin_stage builtin_stage(node_t *node);
+
+// Defined below, with the code that starts processes.
+void move_fd(int from, int to);
+void run_and_exit(node_t *node);
+
+int last_status = 0;
+
 /* Signal handler for SIGINT.
  *
  * This function is called when the SIGINT signal is received (e.g., when Ctrl+C is pressed). It
@@ -39,44 +77,455 @@ void sigint_handler() { signal(SIGINT, sigint_handler); }
 /* Initialize the shell.
  *
  * This function sets up the signal handler for SIGINT, ensuring that the shell consistently handles
- * the interrupt signal.
+ * the interrupt signal, and sets up the variable table and the job table. Job control is only done
+ * when the shell is interactive.
  */
-void initialize(void) { signal(SIGINT, sigint_handler); }
+void initialize(void) {
+    signal(SIGINT, sigint_handler);
+    vars_init();
+    jobs_init(prompt != NULL);
+}
 
 /* Clean up the shell.
  *
- * This function is called when the shell is about to exit. It performs any necessary cleanup.
+ * This function is called when the shell is about to exit. It frees the command hash, the plan
+ * cache and the variables.
+ */
+void shell_exit(void) {
+    command_hash_clear();
+    plan_cache_free();
+    vars_free();
+}
+
+/* Parse a variable reference: $NAME, ${NAME} or $? (the exit status of the last command).
+ *
+ * p: points to a '$'
+ * name: set to the name of the variable, or to "?"
+ * name_len: set to the length of the name
+ *
+ * Returns:
+ * the length of the reference, or 0 if p does not start a reference (a '$' that is kept as is)
+ */
+size_t parse_reference(const char *p, const char **name, size_t *name_len) {
+    size_t len = 0;
+
+    if (p[1] == '?') {
+        *name = p + 1;
+        *name_len = 1;
+        return 2;
+    }
+
+    int braces = p[1] == '{';
+    const char *start = p + 1 + braces;
+    while (isalnum((unsigned char)start[len]) || start[len] == '_') {
+        len++;
+    }
+    if (!var_valid_name(start, len) || (braces && start[len] != '}')) {
+        return 0;
+    }
+
+    *name = start;
+    *name_len = len;
+    return 1 + len + 2 * braces;
+}
+
+/* Expand the variable references in a word.
+ *
+ * A variable that is not set expands to nothing. A character that follows LITERAL_MARK was escaped
+ * or quoted: it is kept as is, without the mark.
+ *
+ * word: the word to expand
+ * status: the exit status of the last command, as text
+ *
+ * Returns:
+ * the word itself if it does not contain a reference or a mark, otherwise an expanded copy in the
+ * current arena
+ */
+char *expand_word(char *word, const char *status) {
+    const char *name;
+    size_t name_len, ref_len;
+    size_t size = 0;
+    int found = 0;
+
+    // Measure the result first, so it can be allocated at once.
+    for (const char *p = word; *p != '\0'; p++) {
+        if (*p == LITERAL_MARK && p[1] != '\0') {
+            size++;
+            p++;
+            found = 1;
+        } else if (*p == '$' && (ref_len = parse_reference(p, &name, &name_len)) != 0) {
+            const char *value = *name == '?' ? status : var_get_n(name, name_len);
+            size += value != NULL ? strlen(value) : 0;
+            p += ref_len - 1;
+            found = 1;
+        } else {
+            size++;
+        }
+    }
+    if (!found) {
+        return word;
+    }
+
+    char *res = arena_malloc(size + 1, 1);
+    char *out = res;
+    for (const char *p = word; *p != '\0'; p++) {
+        if (*p == LITERAL_MARK && p[1] != '\0') {
+            *out++ = *++p;
+        } else if (*p == '$' && (ref_len = parse_reference(p, &name, &name_len)) != 0) {
+            const char *value = *name == '?' ? status : var_get_n(name, name_len);
+            if (value != NULL) {
+                out = stpcpy(out, value);
+            }
+            p += ref_len - 1;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+    return res;
+}
+
+/* The pipe ends that process substitutions have passed to the command that is being started, as
+ * /dev/fd/N arguments. The command inherits them; the shell closes them once it has started the
+ * command with close_substitutions().
+ */
+static int *substitution_fds = NULL;
+static size_t n_substitution_fds = 0;
+static size_t substitution_fds_size = 0;
+
+/* Start a process substitution.
+ *
+ * The command runs in a forked child, connected by a pipe to the command that gets the
+ * substitution as an argument: its output for <(command), its input for >(command). Like bash, the
+ * shell does not wait for it; it is reaped when it finishes.
+ *
+ * child: the AST node of the command in the substitution
+ * output: non-zero for >(command), zero for <(command)
+ *
+ * Returns:
+ * the end of the pipe for the command that gets the substitution, or -1 on failure
+ */
+int start_substitution(node_t *child, int output) {
+    int fds[2];
+
+    if (n_substitution_fds == substitution_fds_size) {
+        size_t size = substitution_fds_size == 0 ? 4 : 2 * substitution_fds_size;
+        int *new_fds = realloc(substitution_fds, size * sizeof(int));
+        if (new_fds == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        substitution_fds = new_fds;
+        substitution_fds_size = size;
+    }
+
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    // The end of the command that gets the substitution, and the end of the substitution itself.
+    int fd = fds[output ? 1 : 0];
+    int other = fds[output ? 0 : 1];
+
+    fflush(stdout);
+    pid_t pid = fork_process();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    } else if (pid == 0) { // Child process
+        job_enter_child(NULL);
+        // Holding the write end of an earlier >(command) would keep it from seeing end-of-file.
+        for (size_t i = 0; i < n_substitution_fds; i++) {
+            close(substitution_fds[i]);
+        }
+        close(fd);
+        move_fd(other, output ? STDIN_FILENO : STDOUT_FILENO);
+        run_and_exit(child);
+    }
+
+    close(other);
+    fcntl(fd, F_SETFD, 0);
+    substitution_fds[n_substitution_fds++] = fd;
+    return fd;
+}
+
+/* Close the pipe ends passed to a command by process substitutions.
+ *
+ * keep: the number of pipe ends to keep open, those of commands that are still being started
+ */
+void close_substitutions(size_t keep) {
+    while (n_substitution_fds > keep) {
+        close(substitution_fds[--n_substitution_fds]);
+    }
+}
+
+/* Expand the arguments of a simple command.
+ *
+ * Process substitutions are started, and replaced by the /dev/fd/N path of their pipe. The caller
+ * closes the pipe ends with close_substitutions() once the command has been started. The AST itself
+ * is not modified, as it may be run again from the plan cache.
+ *
+ * node: the AST node representing the simple command
+ *
+ * Returns:
+ * the node itself if there is nothing to expand, otherwise an expanded copy in the current arena
  */
-void shell_exit(void) {}
+node_t *expand_command(node_t *node) {
+    if (!node->command.expand) {
+        return node;
+    }
+
+    char status[12];
+    snprintf(status, sizeof(status), "%d", last_status);
+
+    node_t *copy = arena_malloc(1, sizeof(node_t));
+    *copy = *node;
+    copy->command.argv = arena_malloc(node->command.argc + 1, sizeof(char *));
+    for (size_t i = 0; i < node->command.argc; i++) {
+        if (i < node->command.n_substs && node->command.substs[i] != NULL) {
+            int fd = start_substitution(node->command.substs[i], node->command.argv[i][0] == '>');
+            copy->command.argv[i] = arena_malloc(sizeof("/dev/fd/") + 11, 1);
+            if (fd == -1) {
+                strcpy(copy->command.argv[i], "/dev/null");
+            } else {
+                sprintf(copy->command.argv[i], "/dev/fd/%d", fd);
+            }
+        } else {
+            copy->command.argv[i] = expand_word(node->command.argv[i], status);
+        }
+    }
+    copy->command.argv[node->command.argc] = NULL;
+    copy->command.program = copy->command.argv[0];
+    // The copy must not be expanded again, its arguments are final.
+    copy->command.expand = 0;
+    copy->command.substs = NULL;
+    copy->command.n_substs = 0;
+    return copy;
+}
 
 /* Execute a sequence of commands.
  *
  * This function runs the first command in the sequence, followed by the second command.
  *
  * node: the AST node representing the sequence of commands
+ *
+ * Returns:
+ * the exit status of the second command
  */
-void execute_sequence_command(node_t *node) {
+int execute_sequence_command(node_t *node) {
     run_command(node->sequence.first);
-    run_command(node->sequence.second);
+    return run_command(node->sequence.second);
+}
+
+/* Execute an && or || command.
+ *
+ * This function runs the first command, and only runs the second command if the first one
+ * succeeded (&&) or failed (||).
+ *
+ * node: the AST node representing the && or || command
+ *
+ * Returns:
+ * the exit status of the last command that was run
+ */
+int execute_and_or_command(node_t *node) {
+    int status = run_command(node->and_or.first);
+
+    if ((status == 0) == (node->type == NODE_AND)) {
+        status = run_command(node->and_or.second);
+    }
+    return status;
+}
+
+/* Check whether a simple command is a variable assignment (NAME=value).
+ *
+ * node: the AST node of the simple command
+ *
+ * Returns:
+ * 1 if the command sets a variable, 0 otherwise
+ */
+int is_assignment(node_t *node) {
+    const char *value = strchr(node->command.program, '=');
+    return node->command.argc == 1 && value != NULL &&
+           var_valid_name(node->command.program, value - node->command.program);
+}
+
+/* Check whether a command can run in the shell itself instead of in a subshell.
+ *
+ * That is the case when it can not change the state of the shell: it sets no variables, runs no
+ * builtins other than those that may run inside the shell as a pipeline stage, and starts no
+ * background jobs. Pipelines, subshells and parallel groups qualify as a whole, as all parts that
+ * could change the state run in processes of their own.
+ *
+ * node: the AST node to check
+ *
+ * Returns:
+ * 1 if the command has no effect on the state of the shell, 0 otherwise
+ */
+int is_side_effect_free(node_t *node) {
+    switch (node->type) {
+    case NODE_COMMAND:
+        // A program name that is expanded could turn out to be a builtin.
+        return !node->command.expand && !is_assignment(node) &&
+               (!is_builtin(node->command.program) || builtin_stage(node) == STAGE_INLINE);
+    case NODE_REDIRECT:
+        return is_side_effect_free(node->redirect.child);
+    case NODE_SEQUENCE:
+        return is_side_effect_free(node->sequence.first) &&
+               is_side_effect_free(node->sequence.second);
+    case NODE_AND:
+    case NODE_OR:
+        return is_side_effect_free(node->and_or.first) && is_side_effect_free(node->and_or.second);
+    case NODE_TIME:
+        return is_side_effect_free(node->time.child);
+    case NODE_PIPE:
+    case NODE_SUBSHELL:
+    case NODE_PARALLEL:
+        return 1;
+    case NODE_DETACH:
+        return 0;
+    }
+    return 0;
+}
+
+/* Run a command in a forked child and exit with its exit status.
+ *
+ * The child already is a process of its own, so subshells in it need no further fork, and if the
+ * command ends with an external command, that command replaces the child (exec-in-place) instead of
+ * being started as another process. With tracing enabled the command is simply run, so every node
+ * is still recorded.
+ *
+ * node: the AST node representing the command
+ */
+void run_and_exit(node_t *node) {
+    if (trace_fd != -1) {
+        exit(run_command(node));
+    }
+
+    for (;;) {
+        if (node->type == NODE_SUBSHELL) {
+            node = node->subshell.child;
+        } else if (node->type == NODE_SEQUENCE) {
+            run_command(node->sequence.first);
+            node = node->sequence.second;
+        } else {
+            break;
+        }
+    }
+
+    if (node->type == NODE_COMMAND) {
+        // The arena is popped when the child exits.
+        if (node->command.expand) {
+            arena_push();
+            node = expand_command(node);
+        }
+        if (!is_builtin(node->command.program) && !is_assignment(node)) {
+            const char *path = command_hash_lookup(node->command.program);
+            if (path == NULL) {
+                errno = ENOENT;
+                perror(node->command.program);
+                exit(127);
+            }
+
+            // Like the spawn backend, give the program the default signal handling.
+            fflush(stdout);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            signal(SIGTTIN, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+            exec_program(path, node->command.argv);
+            perror("execve");
+            exit(126);
+        }
+    }
+
+    exit(run_command(node));
 }
 
 /* Execute a subshell command.
  *
- * This function creates a child process to execute the command within a subshell.
+ * This function creates a child process to execute the command within a subshell. A command that
+ * can not change the state of the shell runs without the fork when the shell does no job control;
+ * with job control a subshell is kept, so Ctrl+Z stops the subshell as a whole.
  *
  * node: the AST node representing the subshell command
+ *
+ * Returns:
+ * the exit status of the subshell
  */
-void execute_subshell_command(node_t *node) {
-    pid_t pid = fork();
+int execute_subshell_command(node_t *node) {
+    if (!job_control && is_side_effect_free(node->subshell.child)) {
+        return run_command(node->subshell.child);
+    }
+
+    struct job *job = job_create(node, 1);
+
+    pid_t pid = fork_process();
     if (pid < 0) {
         perror("fork");
         exit(EXIT_FAILURE);
     } else if (pid == 0) { // Child process
-        run_command(node->subshell.child);
-        exit(EXIT_SUCCESS);
-    } else { // Parent process
-        int status;
-        waitpid(pid, &status, 0);
+        job_enter_child(job);
+        run_and_exit(node->subshell.child);
+    }
+
+    // Parent process
+    job_add_process(job, pid, node);
+    return job_wait(job);
+}
+
+// Saved copies of redirected file descriptors are moved to this number or higher, out of the way of
+// file descriptors used by commands.
+const int SAVED_FD_MIN = 10;
+
+/* A file descriptor that has been redirected, together with a copy of what it referred to before
+ * the redirect.
+ */
+struct saved_fd {
+    int fd;
+    int saved; // -1 if fd was not open before the redirect
+};
+
+/* Redirect a file descriptor of the shell itself, saving its old value.
+ *
+ * from: the file descriptor to duplicate
+ * to: the file descriptor to redirect
+ * save: filled with what is needed to undo the redirect using restore_fd
+ *
+ * Returns:
+ * 0 on success, -1 on failure (in which case nothing has to be restored)
+ */
+int redirect_fd(int from, int to, struct saved_fd *save) {
+    save->fd = to;
+    save->saved = fcntl(to, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+    if (save->saved == -1 && errno != EBADF) {
+        perror("fcntl");
+        return -1;
+    }
+
+    if (dup2(from, to) == -1) {
+        perror("dup2");
+        if (save->saved != -1) {
+            close(save->saved);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Undo a redirect made by redirect_fd.
+ *
+ * save: the saved file descriptor
+ */
+void restore_fd(struct saved_fd *save) {
+    if (save->saved == -1) {
+        close(save->fd);
+    } else {
+        dup2(save->saved, save->fd);
+        close(save->saved);
     }
 }
 
@@ -84,108 +533,443 @@ void execute_subshell_command(node_t *node) {
 const int PIPE_INPUT = 0;
 const int PIPE_OUTPUT = 1;
 
-/* Fork processes for each command in a pipeline.
+/* Check whether a command can be started with the spawn backend.
  *
- * This function creates a child process for each command in a pipeline, setting up the necessary
- * pipes for communication between the processes.
+ * Only plain external commands qualify: builtins, subshells, sequences and the like need a copy of
+ * the shell to run in, so those are still forked.
  *
- * node: the AST node representing the pipeline command
- * pipe_fds: an array of pipe file descriptors
- * pipe_count: the number of pipes in the pipeline
- * pipeline_commands: an array of AST nodes representing the commands in the pipeline
+ * node: the AST node to check
+ *
+ * Returns:
+ * 1 if the command can be spawned, 0 otherwise
  */
-void fork_processes(node_t *node, int pipe_fds[][2], size_t pipe_count,
-                    node_t **pipeline_commands) {
-    for (size_t i = 0; i < node->pipe.n_parts; i++) {
-        pid_t pid = fork();
-        if (pid == -1) {
-            perror("fork");
-            exit(EXIT_FAILURE);
-        } else if (pid == 0) { // Child process
-            // Close unused write ends of previous pipes
-            for (size_t j = 0; j < i; j++) {
-                close(pipe_fds[j][PIPE_OUTPUT]);
-            }
-            // Close unused read ends of subsequent pipes
-            for (size_t j = i + 1; j < pipe_count; j++) {
-                close(pipe_fds[j][PIPE_INPUT]);
-                close(pipe_fds[j][PIPE_OUTPUT]);
-            }
+int can_spawn(node_t *node) {
+    return use_spawn && node->type == NODE_COMMAND && !is_builtin(node->command.program);
+}
 
-            // Redirect input/output
-            if (i != 0) {
-                dup2(pipe_fds[i - 1][PIPE_INPUT], STDIN_FILENO);
-                close(pipe_fds[i - 1][PIPE_INPUT]);
-            }
-            if (i != pipe_count) {
-                dup2(pipe_fds[i][PIPE_OUTPUT], STDOUT_FILENO);
-                close(pipe_fds[i][PIPE_OUTPUT]);
-            }
+/* Move a file descriptor onto a standard stream in a forked child.
+ *
+ * The pipes of a pipeline are created with O_CLOEXEC, so a descriptor that already is the standard
+ * stream only needs that flag cleared, any other descriptor is duplicated and then closed.
+ *
+ * from: the file descriptor to move, or -1 to keep the stream of the shell
+ * to: the standard stream
+ */
+void move_fd(int from, int to) {
+    if (from == -1) {
+        return;
+    }
+    if (from == to) {
+        fcntl(to, F_SETFD, 0);
+    } else {
+        dup2(from, to);
+        close(from);
+    }
+}
+
+// The last value of $PIPESIZE that was invalid or that the kernel refused, or NULL. Such a value is
+// only reported once, and then ignored for as long as the variable keeps it.
+static char *rejected_pipe_size = NULL;
+
+/* Remember that a value of $PIPESIZE was rejected, after it has been reported.
+ *
+ * value: the value of $PIPESIZE
+ */
+void reject_pipe_size(const char *value) {
+    free(rejected_pipe_size);
+    rejected_pipe_size = strdup(value);
+}
+
+/* Read the pipe size requested with $PIPESIZE.
+ *
+ * The size is a number of bytes, optionally followed by k or m for KiB or MiB, e.g.
+ * "set PIPESIZE=1m". Larger pipes let the stages of a high-throughput pipeline move more data per
+ * context switch.
+ *
+ * Returns:
+ * the requested size, or 0 to keep the default size of the kernel
+ */
+long requested_pipe_size(void) {
+    const char *value = var_get("PIPESIZE");
+    char *end;
+
+    if (value == NULL || *value == '\0' ||
+        (rejected_pipe_size != NULL && strcmp(value, rejected_pipe_size) == 0)) {
+        return 0;
+    }
+
+    long size = strtol(value, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || size <= 0 || size > INT_MAX) {
+        fprintf(stderr, "PIPESIZE: invalid size: %s\n", value);
+        reject_pipe_size(value);
+        return 0;
+    }
+    return size;
+}
 
-            run_command(pipeline_commands[i]);
-            exit(EXIT_SUCCESS);
+/* Start a single stage of a pipeline.
+ *
+ * The stage only gets the two pipe ends it uses. External commands are spawned directly with the
+ * ends duplicated onto stdin/stdout; every other pipe descriptor has O_CLOEXEC set and so does not
+ * reach the program. All other stages run in a forked copy of the shell, which closes the other
+ * pipe ends it inherits itself: the read end of its own output pipe, which the parent still holds
+ * for the next stage, and the pipe ends held for a stage that runs inside the shell.
+ *
+ * node: the AST node of the stage
+ * job: the job of the pipeline
+ * in_fd: the read end of the pipe from the previous stage, or -1 for the first stage
+ * out_fd: the write end of the pipe to the next stage, or -1 for the last stage
+ * close_fds: the pipe ends a forked child has to close, -1 for unused entries
+ *
+ * Returns:
+ * the pid of the started process, or -1 on failure
+ */
+pid_t start_pipeline_stage(node_t *node, struct job *job, int in_fd, int out_fd,
+                           const int close_fds[3]) {
+    if (can_spawn(node)) {
+        size_t n_fds = n_substitution_fds;
+        int expand = node->command.expand;
+
+        if (expand) {
+            arena_push();
+            node = expand_command(node);
+        }
+
+        pid_t pid = spawn_command(node->command.argv, spawn_dup_actions(in_fd, out_fd),
+                                  job_pgid(job));
+        close_substitutions(n_fds);
+        if (expand) {
+            arena_pop();
         }
+        return pid;
+    }
+
+    pid_t pid = fork_process();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    } else if (pid == 0) { // Child process
+        job_enter_child(job);
+        for (int i = 0; i < 3; i++) {
+            if (close_fds[i] != -1) {
+                close(close_fds[i]);
+            }
+        }
+        move_fd(in_fd, STDIN_FILENO);
+        move_fd(out_fd, STDOUT_FILENO);
+        run_and_exit(node);
+    }
+    return pid;
+}
+
+/* Run a stage of a pipeline inside the shell itself.
+ *
+ * The standard input and output of the shell are redirected to the pipe ends of the stage while the
+ * builtin runs, and restored afterwards. The pipe ends themselves are closed, so the neighbouring
+ * stages see end-of-file or a broken pipe as soon as the builtin is done. A write to a pipe
+ * whose reader has gone fails with EPIPE instead of killing the shell.
+ *
+ * node: the AST node of the stage, a builtin that runs inline
+ * in_fd: the read end of the pipe from the previous stage, or -1 for the first stage
+ * out_fd: the write end of the pipe to the next stage, or -1 for the last stage
+ *
+ * Returns:
+ * the exit status of the builtin, or 1 if the pipe ends could not be redirected
+ */
+int run_inline_stage(node_t *node, int in_fd, int out_fd) {
+    struct saved_fd saved[2];
+    size_t n_saved = 0;
+    size_t n_needed = (in_fd != -1) + (out_fd != -1);
+    int status = 1;
+
+    fflush(stdout);
+    if (in_fd != -1 && redirect_fd(in_fd, STDIN_FILENO, &saved[n_saved]) == 0) {
+        n_saved++;
+    }
+    if (out_fd != -1 && redirect_fd(out_fd, STDOUT_FILENO, &saved[n_saved]) == 0) {
+        n_saved++;
+    }
+    if (in_fd != -1 && in_fd != STDIN_FILENO) {
+        close(in_fd);
+    }
+    if (out_fd != -1 && out_fd != STDOUT_FILENO) {
+        close(out_fd);
+    }
+
+    if (n_saved == n_needed) {
+        void (*old_handler)(int) = signal(SIGPIPE, SIG_IGN);
+        status = run_command(node);
+        signal(SIGPIPE, old_handler);
+    }
+
+    while (n_saved > 0) {
+        restore_fd(&saved[--n_saved]);
     }
+    return status;
 }
 
 /* Execute a pipeline command.
  *
  * This function creates a pipeline of commands, with the output of each command connected to the
- * input of the next command.
+ * input of the next command. Each pipe is only created right before the stage that writes to it is
+ * started, and the parent closes its copies of the pipe ends as soon as the stages that use them
+ * are running. All processes are added to the job of the pipeline. When $PIPESIZE is set, every
+ * pipe is resized to it. A size that is invalid or refused by the kernel is reported once for as
+ * long as $PIPESIZE keeps that value.
+ *
+ * Builtins that only change the state of the shell (cd, set, unset) have no effect in a pipeline,
+ * so no process is started for them at all. One builtin that moves data (relay) may run inside the
+ * shell instead of in a forked copy; it is started after all other stages, so it never waits for a
+ * stage that does not exist yet. This is only done without job control: an interactive shell
+ * keeps forking such stages, so the terminal can be given to the job as a whole.
  *
  * node: the AST node representing the pipeline command
+ *
+ * Returns:
+ * the exit status of the last command in the pipeline
  */
-void execute_pipe_command(node_t *node) {
-    size_t pipe_count = node->pipe.n_parts - 1;
+int execute_pipe_command(node_t *node) {
+    struct job *job = job_create(node, 1);
+    node_t *inline_stage = NULL;
+    int inline_fds[2] = {-1, -1};
+    int inline_last = 0;
+    int noop_last = 0;
+    int in_fd = -1;
+    long pipe_size = requested_pipe_size();
+
+    for (size_t i = 0; i < node->pipe.n_parts; i++) {
+        node_t *part = node->pipe.parts[i];
+        int last = i + 1 == node->pipe.n_parts;
+        int pipe_fds[2] = {-1, -1};
+        enum builtin_stage stage = builtin_stage(part);
 
-    int pipe_fds[pipe_count][2];
+        if (!last && pipe2(pipe_fds, O_CLOEXEC) == -1) {
+            // Stop here, the stages that are already running see end-of-file or a broken pipe
+            perror("pipe2");
+            break;
+        }
+        if (pipe_fds[PIPE_OUTPUT] != -1 && pipe_size != 0 &&
+            fcntl(pipe_fds[PIPE_OUTPUT], F_SETPIPE_SZ, (int)pipe_size) == -1) {
+            // Too large for /proc/sys/fs/pipe-max-size: the rest of the pipes get the default
+            perror("F_SETPIPE_SZ");
+            reject_pipe_size(var_get("PIPESIZE"));
+            pipe_size = 0;
+        }
 
-    // Create pipes
-    for (size_t i = 0; i < pipe_count; i++) {
-        if (pipe(pipe_fds[i]) == -1) {
-            perror("pipe");
-            exit(EXIT_FAILURE);
+        if (stage == STAGE_INLINE && inline_stage == NULL && !job_control) {
+            // The parent keeps both pipe ends until the stage runs
+            inline_stage = part;
+            inline_fds[0] = in_fd;
+            inline_fds[1] = pipe_fds[PIPE_OUTPUT];
+            inline_last = last;
+            in_fd = pipe_fds[PIPE_INPUT];
+            continue;
         }
+
+        if (stage == STAGE_NOOP) {
+            noop_last = last;
+        } else {
+            int close_fds[3] = {pipe_fds[PIPE_INPUT], inline_fds[0], inline_fds[1]};
+            pid_t pid =
+                start_pipeline_stage(part, job, in_fd, pipe_fds[PIPE_OUTPUT], close_fds);
+            if (pid != -1) {
+                job_add_process(job, pid, part);
+            }
+        }
+
+        // The parent only keeps the read end, for the next stage
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (pipe_fds[PIPE_OUTPUT] != -1) {
+            close(pipe_fds[PIPE_OUTPUT]);
+        }
+        in_fd = pipe_fds[PIPE_INPUT];
+    }
+    if (in_fd != -1) {
+        close(in_fd);
     }
 
-    // Fork processes for each command in the pipeline
-    fork_processes(node, pipe_fds, pipe_count, node->pipe.parts);
+    int inline_status = 0;
+    if (inline_stage != NULL) {
+        inline_status = run_inline_stage(inline_stage, inline_fds[0], inline_fds[1]);
+    }
 
-    // Close all pipe ends in the parent process
-    for (size_t i = 0; i < pipe_count; i++) {
-        close(pipe_fds[i][PIPE_INPUT]);
-        close(pipe_fds[i][PIPE_OUTPUT]);
+    // Wait for the processes of this pipeline only
+    int status = job_wait(job);
+    if (inline_last) {
+        return inline_status;
     }
+    return noop_last ? 0 : status;
+}
 
-    // Wait for all child processes to finish
-    for (size_t i = 0; i < node->pipe.n_parts; i++) {
-        int status;
-        wait(&status);
+/* Read the concurrency limit of parallel groups from $PARALLEL.
+ *
+ * Returns:
+ * the value of $PARALLEL, or the number of online processors if it is not set or invalid
+ */
+size_t parallel_limit(void) {
+    const char *value = var_get("PARALLEL");
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (value != NULL && *value != '\0') {
+        char *end;
+        long limit = strtol(value, &end, 10);
+        if (*end == '\0' && limit > 0) {
+            return limit;
+        }
+        fprintf(stderr, "PARALLEL: invalid limit: %s\n", value);
     }
+    return cpus > 0 ? cpus : 1;
+}
+
+/* Execute a parallel group.
+ *
+ * This function runs the parts of a group like { a ;; b ;; c } concurrently, each in a process of
+ * its own, but never more at the same time than $PARALLEL (by default the number of processors).
+ * A new part is started as soon as a running part has finished. All processes are added to the job
+ * of the group.
+ *
+ * node: the AST node representing the parallel group
+ *
+ * Returns:
+ * the exit status of the first part that failed, or 0 if all parts succeeded
+ */
+int execute_parallel_command(node_t *node) {
+    static const int no_fds[3] = {-1, -1, -1};
+    struct job *job = job_create(node, 1);
+    size_t limit = parallel_limit();
+    int status = 0;
+
+    for (size_t i = 0; i < node->parallel.n_parts; i++) {
+        // Wait for a free slot, stop starting parts if the user has stopped the group.
+        status = job_wait_limit(job, limit - 1);
+        if (status == -1) {
+            break;
+        }
+
+        node_t *part = node->parallel.parts[i];
+        pid_t pid = start_pipeline_stage(part, job, -1, -1, no_fds);
+        if (pid != -1) {
+            job_add_process(job, pid, part);
+        }
+    }
+
+    if (status != -1) {
+        status = job_wait_limit(job, 0);
+    }
+    int job_status = job_wait(job);
+    return status == -1 ? job_status : status;
 }
 
 /* Execute a detached command.
  *
  * This function creates a child process to execute the command in the background, without waiting
- * for its completion.
+ * for its completion. The child is a background job, it is reaped by the SIGCHLD handler.
  *
  * node: the AST node representing the detached command
+ *
+ * Returns:
+ * 0, as the command has not finished yet
  */
-void execute_detach_command(node_t *node) {
-    pid_t pid = fork();
+int execute_detach_command(node_t *node) {
+    struct job *job = job_create(node->detach.child, 0);
+
+    pid_t pid = fork_process();
     if (pid == -1) {
         perror("fork");
         exit(EXIT_FAILURE);
     } else if (pid == 0) { // Child process
-        run_command(node->detach.child);
-        exit(EXIT_SUCCESS);
+        job_enter_child(job);
+        run_and_exit(node->detach.child);
     }
+
     // Parent process continues without waiting for the child
+    job_add_process(job, pid, node->detach.child);
+    job_detach(job);
+    return 0;
+}
+
+/* Write all of a buffer to a file descriptor.
+ *
+ * fd: the file descriptor
+ * buf: the data
+ * len: the length of the data
+ *
+ * Returns:
+ * 0 on success, -1 on error
+ */
+int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Open the input of a here-document or here-string.
+ *
+ * The text never touches the file system. When it fits in a pipe, it is written to a new pipe of
+ * which only the read end is kept, so the write can not block. A larger text goes into an anonymous
+ * memory file, which the command then reads from the start.
+ *
+ * text: the text
+ * newline: non-zero to add a newline after the text, as a here-string does
+ *
+ * Returns:
+ * the file descriptor to read the text from, or -1 on error
+ */
+int open_here_document(const char *text, int newline) {
+    size_t len = strlen(text);
+    int fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        return -1;
+    }
+
+    int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+    if (capacity != -1 && len + newline <= (size_t)capacity) {
+        if (write_all(fds[1], text, len) == -1 || write_all(fds[1], "\n", newline) == -1) {
+            close(fds[0]);
+            fds[0] = -1;
+        }
+        close(fds[1]);
+        return fds[0];
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    int fd = memfd_create("42sh-here-document", MFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (write_all(fd, text, len) == -1 || write_all(fd, "\n", newline) == -1 ||
+        lseek(fd, 0, SEEK_SET) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
 /* Open a file for redirection.
  *
- * This function opens a file for redirection based on the specified mode.
+ * This function opens a file for redirection based on the specified mode. Variable references in
+ * a file name or here-string are expanded first, like the arguments of a simple command; the
+ * expansion only lives in an arena frame until the file is open.
  *
  * node: the AST node representing the redirect command
  *
@@ -193,14 +977,26 @@ void execute_detach_command(node_t *node) {
  * the file descriptor of the opened file
  */
 int open_file_for_redirect(node_t *node) {
+    char *target = node->redirect.target;
     int fd;
 
+    if (node->redirect.expand) {
+        char status[12];
+        snprintf(status, sizeof(status), "%d", last_status);
+        arena_push();
+        target = expand_word(target, status);
+    }
+
     if (node->redirect.mode == REDIRECT_APPEND) {
-        fd = open(node->redirect.target, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        fd = open(target, O_WRONLY | O_CREAT | O_APPEND, 0644);
     } else if (node->redirect.mode == REDIRECT_OUTPUT) {
-        fd = open(node->redirect.target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
     } else if (node->redirect.mode == REDIRECT_INPUT) {
-        fd = open(node->redirect.target, O_RDONLY);
+        fd = open(target, O_RDONLY);
+    } else if (node->redirect.mode == REDIRECT_HEREDOC) {
+        fd = open_here_document(target, 0);
+    } else if (node->redirect.mode == REDIRECT_HERESTRING) {
+        fd = open_here_document(target, 1);
     } else if (node->redirect.mode == REDIRECT_DUP) {
         fd = node->redirect.fd2;
     } else {
@@ -208,46 +1004,80 @@ int open_file_for_redirect(node_t *node) {
         exit(EXIT_FAILURE);
     }
 
+    if (node->redirect.expand) {
+        int saved_errno = errno;
+        arena_pop();
+        errno = saved_errno;
+    }
     return fd;
 }
 
 /* Execute a redirect command.
  *
- * This function creates a child process to execute the command with input/output redirected as
- * specified.
+ * This function redirects the file descriptors of the shell itself, runs the command and restores
+ * the file descriptors afterwards. No child process is needed for this: builtins are affected by
+ * the redirect and external commands inherit the redirected file descriptors when they are
+ * started.
  *
  * node: the AST node representing the redirect command
+ *
+ * Returns:
+ * the exit status of the command, or 1 if the redirect failed
  */
-void execute_redirect_command(node_t *node) {
-    pid_t pid = fork();
+int execute_redirect_command(node_t *node) {
+    struct saved_fd saved[2];
+    size_t n_saved = 0;
+    int status = 1;
+    int fd = open_file_for_redirect(node);
 
-    if (pid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-    } else if (pid == 0) { // Child process
-        int fd = open_file_for_redirect(node);
+    if (fd == -1) {
+        perror("open");
+        return status;
+    }
 
-        if (fd == -1) {
-            perror("open");
-            exit(EXIT_FAILURE);
+    // open() returns the lowest free file descriptor, which may be the one that is redirected. Move
+    // the file out of the way, or redirect_fd would save the file as the old state.
+    if (node->redirect.mode != REDIRECT_DUP &&
+        (fd == node->redirect.fd ||
+         (node->redirect.fd == -1 && (fd == STDOUT_FILENO || fd == STDERR_FILENO)))) {
+        int moved = fcntl(fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+        close(fd);
+        if (moved == -1) {
+            perror("fcntl");
+            return status;
         }
+        fd = moved;
+    }
 
-        if (dup2(fd, node->redirect.fd) == -1) {
-            perror("dup2");
-            close(fd);
-            exit(EXIT_FAILURE);
-        }
+    // Anything the shell buffered so far belongs to the old file descriptors.
+    fflush(stdout);
+    fflush(stderr);
 
-        if (node->redirect.fd != fd) {
-            close(fd);
+    if (node->redirect.fd == -1) { // Both stdout and stderr
+        if (redirect_fd(fd, STDOUT_FILENO, &saved[n_saved]) == 0) {
+            n_saved++;
+            if (redirect_fd(fd, STDERR_FILENO, &saved[n_saved]) == 0) {
+                n_saved++;
+            }
         }
+    } else if (redirect_fd(fd, node->redirect.fd, &saved[n_saved]) == 0) {
+        n_saved++;
+    }
 
-        run_command(node->redirect.child);
-        exit(EXIT_FAILURE);
-    } else { // Parent process
-        int status;
-        waitpid(pid, &status, 0);
+    if (node->redirect.mode != REDIRECT_DUP) {
+        close(fd);
     }
+
+    if (n_saved == (node->redirect.fd == -1 ? 2 : 1)) {
+        status = run_command(node->redirect.child);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    while (n_saved > 0) {
+        restore_fd(&saved[--n_saved]);
+    }
+    return status;
 }
 
 /* Execute an exit command.
@@ -256,7 +1086,7 @@ void execute_redirect_command(node_t *node) {
  *
  * node: the AST node representing the exit command
  */
-void execute_exit_command(node_t *node) {
+int execute_exit_command(node_t *node) {
     if (node->command.argc == 1) {
         exit(42);
     } else {
@@ -269,136 +1099,518 @@ void execute_exit_command(node_t *node) {
  * This function changes the current working directory as specified by the command arguments.
  *
  * node: the AST node representing the cd command
+ *
+ * Returns:
+ * 0 on success, 1 if the directory could not be changed
  */
-void execute_cd_command(node_t *node) {
-    if (node->command.argc == 1) {
-        const char *home = getenv("HOME");
-        if (home != NULL) {
-            chdir(home);
-        }
-    } else {
-        chdir(node->command.argv[1]);
+int execute_cd_command(node_t *node) {
+    const char *dir = node->command.argc == 1 ? var_get("HOME") : node->command.argv[1];
+
+    if (dir != NULL && chdir(dir) == -1) {
+        perror("cd");
+        return 1;
     }
+    return 0;
 }
 
 /* Execute a set command.
  *
- * This function sets an environment variable with the specified name and value.
+ * This function sets a variable with the specified name and value, and exports it.
  *
  * node: the AST node representing the set command
+ *
+ * Returns:
+ * 0 on success
  */
-void execute_set_command(node_t *node) {
+int execute_set_command(node_t *node) {
     if (node->command.argc != 2) {
         perror("Usage: set <env_var=value>");
         exit(EXIT_FAILURE);
     } else {
-        char *env_var = strtok(node->command.argv[1], "=");
-        char *value = strtok(NULL, "=");
-        if (env_var == NULL || value == NULL) {
+        // The argument is not modified: the AST may be executed again from the plan cache.
+        const char *arg = node->command.argv[1];
+        const char *value = strchr(arg, '=');
+        if (value == NULL || !var_valid_name(arg, value - arg) || value[1] == '\0') {
             perror("Invalid format. Usage: set <env_var=value>");
             exit(EXIT_FAILURE);
         }
-        if (setenv(env_var, value, 1) != 0) {
-            perror("setenv");
-            exit(EXIT_FAILURE);
+        var_set(arg, value - arg, value + 1, 1);
+    }
+    return 0;
+}
+
+/* Execute an export command.
+ *
+ * This function exports the given variables, so they are passed to the commands the shell starts.
+ * An argument of the form NAME=value sets the variable as well.
+ *
+ * node: the AST node representing the export command
+ *
+ * Returns:
+ * 0 on success, 1 if an argument is not a valid variable name, 2 on a usage error
+ */
+int execute_export_command(node_t *node) {
+    int status = 0;
+
+    if (node->command.argc == 1) {
+        fprintf(stderr, "Usage: export NAME[=value]...\n");
+        return 2;
+    }
+
+    for (size_t i = 1; i < node->command.argc; i++) {
+        const char *arg = node->command.argv[i];
+        const char *value = strchr(arg, '=');
+        size_t name_len = value != NULL ? (size_t)(value - arg) : strlen(arg);
+
+        if (!var_valid_name(arg, name_len)) {
+            fprintf(stderr, "export: %s: not a valid name\n", arg);
+            status = 1;
+        } else if (value != NULL) {
+            var_set(arg, name_len, value + 1, 1);
+        } else {
+            var_export(arg);
         }
     }
+    return status;
 }
 
 /* Execute an unset command.
  *
- * This function unsets (removes) the specified environment variable.
+ * This function unsets (removes) the specified variable.
  *
  * node: the AST node representing the unset command
+ *
+ * Returns:
+ * 0 on success
  */
-void execute_unset_command(node_t *node) {
+int execute_unset_command(node_t *node) {
     if (node->command.argc < 2) {
         perror("Usage: unset <variable>");
         exit(EXIT_FAILURE);
     } else {
-        if (unsetenv(node->command.argv[1]) != 0) {
-            perror("unsetenv");
-            exit(EXIT_FAILURE);
-        }
+        var_unset(node->command.argv[1]);
     }
+    return 0;
+}
+
+/* Execute a hash command.
+ *
+ * This function prints the contents of the command hash, or clears it when called as "hash -r".
+ *
+ * node: the AST node representing the hash command
+ *
+ * Returns:
+ * 0 on success, 2 on a usage error
+ */
+int execute_hash_command(node_t *node) {
+    if (node->command.argc == 1) {
+        command_hash_print();
+    } else if (node->command.argc == 2 && strcmp(node->command.argv[1], "-r") == 0) {
+        command_hash_clear();
+    } else {
+        fprintf(stderr, "Usage: hash [-r]\n");
+        return 2;
+    }
+    return 0;
+}
+
+/* Execute a plans command.
+ *
+ * This function prints the statistics of the plan cache, or clears it when called as "plans -r".
+ *
+ * node: the AST node representing the plans command
+ *
+ * Returns:
+ * 0 on success, 2 on a usage error
+ */
+int execute_plans_command(node_t *node) {
+    if (node->command.argc == 1) {
+        plan_cache_print();
+    } else if (node->command.argc == 2 && strcmp(node->command.argv[1], "-r") == 0) {
+        plan_cache_clear();
+    } else {
+        fprintf(stderr, "Usage: plans [-r]\n");
+        return 2;
+    }
+    return 0;
 }
 
 /* Execute an external command.
  *
- * This function executes an external command using execvp in a child process.
+ * This function starts an external command using the spawn backend, or using execv in a forked
+ * child process when spawning is disabled, and waits for it to finish.
  *
  * node: the AST node representing the external command
+ *
+ * Returns:
+ * the exit status of the command, or 127 if it could not be started
  */
-void execute_external_command(node_t *node) {
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-    } else if (pid == 0) { // Child process
-        execvp(node->command.program, node->command.argv);
-        perror("execvp");
-        exit(EXIT_FAILURE);
-    } else { // Parent process
-        int status;
-        signal(SIGINT, SIG_IGN);
-        waitpid(pid, &status, 0);
+int execute_external_command(node_t *node) {
+    struct job *job = job_create(node, 1);
+    pid_t pid;
+
+    if (use_spawn) {
+        pid = spawn_command(node->command.argv, NULL, job_pgid(job));
+        if (pid == -1) {
+            job_wait(job);
+            return 127;
+        }
+    } else {
+        // Look the program up before forking, so the command hash of the shell itself is updated.
+        const char *path = command_hash_lookup(node->command.program);
+        if (path == NULL) {
+            errno = ENOENT;
+            perror(node->command.program);
+            job_wait(job);
+            return 127;
+        }
+
+        pid = fork_process();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) { // Child process
+            job_enter_child(job);
+            exec_program(path, node->command.argv);
+            perror("execve");
+            exit(126);
+        }
+    }
+
+    // Parent process
+    job_add_process(job, pid, node);
+    signal(SIGINT, SIG_IGN);
+    return job_wait(job);
+}
+
+/* Execute a jobs command.
+ *
+ * This function lists the jobs of the shell.
+ *
+ * node: the AST node representing the jobs command
+ *
+ * Returns:
+ * 0
+ */
+int execute_jobs_command(node_t *node) {
+    (void)node;
+    jobs_print();
+    return 0;
+}
+
+/* Execute an fg command.
+ *
+ * This function continues a job in the foreground and waits for it.
+ *
+ * node: the AST node representing the fg command
+ *
+ * Returns:
+ * the exit status of the job, or 1 if there is no such job
+ */
+int execute_fg_command(node_t *node) {
+    return jobs_fg(node->command.argc > 1 ? node->command.argv[1] : NULL);
+}
+
+/* Execute a bg command.
+ *
+ * This function continues a stopped job in the background.
+ *
+ * node: the AST node representing the bg command
+ *
+ * Returns:
+ * 0 on success, 1 if there is no such job
+ */
+int execute_bg_command(node_t *node) {
+    return jobs_bg(node->command.argc > 1 ? node->command.argv[1] : NULL);
+}
+
+/* Execute a wait command.
+ *
+ * This function waits for one job (or process), or for all background jobs if no argument is
+ * given.
+ *
+ * node: the AST node representing the wait command
+ *
+ * Returns:
+ * the exit status of the job that was waited for, 0 if there was none, or 127 if there is
+ * no such job
+ */
+int execute_wait_command(node_t *node) {
+    return jobs_wait(node->command.argc > 1 ? node->command.argv[1] : NULL);
+}
+
+/* Copy a file descriptor to the standard output for the relay builtin.
+ *
+ * fd: the file descriptor to copy
+ * name: the name of the file, used in error messages
+ *
+ * Returns:
+ * 0 on success, 1 on failure, or 141 if the output is a broken pipe
+ */
+int relay_to_stdout(int fd, const char *name) {
+    if (relay(fd, STDOUT_FILENO) == 0) {
+        return 0;
+    } else if (errno == EPIPE) {
+        // The reader is gone: report it the way a process killed by SIGPIPE would be.
+        return 128 + SIGPIPE;
     }
+    perror(name);
+    return 1;
+}
+
+/* Execute a relay command.
+ *
+ * This function copies the given files, or the standard input if there are none, to the standard
+ * output, like cat. It is meant as a pipeline stage that runs inside the shell: the data is moved
+ * with splice() where possible, so it is not copied through the shell.
+ *
+ * node: the AST node representing the relay command
+ *
+ * Returns:
+ * 0 on success, 1 if a file could not be copied, or 141 if the output is a broken pipe
+ */
+int execute_relay_command(node_t *node) {
+    int status = 0;
+
+    fflush(stdout);
+    if (node->command.argc == 1) {
+        return relay_to_stdout(STDIN_FILENO, "relay");
+    }
+
+    for (size_t i = 1; i < node->command.argc && status != 128 + SIGPIPE; i++) {
+        int fd = open(node->command.argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            perror(node->command.argv[i]);
+            status = 1;
+            continue;
+        }
+
+        int res = relay_to_stdout(fd, node->command.argv[i]);
+        close(fd);
+        if (res != 0) {
+            status = res;
+        }
+    }
+    return status;
+}
+
+/* Execute a bench command.
+ *
+ * This function measures what a command line costs, see bench_command().
+ *
+ * node: the AST node representing the bench command
+ *
+ * Returns:
+ * 0, or 2 if the arguments are invalid
+ */
+int execute_bench_command(node_t *node) {
+    return bench_command(node->command.argc, node->command.argv);
+}
+
+/* A builtin command: a command that is executed by the shell itself. */
+struct builtin {
+    const char *name;
+    int (*execute)(node_t *node);
+    enum builtin_stage stage;
+};
+
+static const struct builtin builtins[] = {
+    {"exit", execute_exit_command, STAGE_FORK},
+    {"cd", execute_cd_command, STAGE_NOOP},
+    {"set", execute_set_command, STAGE_NOOP},
+    {"unset", execute_unset_command, STAGE_NOOP},
+    {"export", execute_export_command, STAGE_NOOP},
+    {"hash", execute_hash_command, STAGE_FORK},
+    {"plans", execute_plans_command, STAGE_FORK},
+    {"jobs", execute_jobs_command, STAGE_FORK},
+    {"fg", execute_fg_command, STAGE_FORK},
+    {"bg", execute_bg_command, STAGE_FORK},
+    {"wait", execute_wait_command, STAGE_FORK},
+    {"relay", execute_relay_command, STAGE_INLINE},
+    {"bench", execute_bench_command, STAGE_FORK},
+};
+
+/* Look up a builtin command.
+ *
+ * program: the name of the command
+ *
+ * Returns:
+ * the builtin with the given name, or NULL if there is none
+ */
+const struct builtin *find_builtin(const char *program) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strcmp(program, builtins[i].name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+/* Check whether a command is a builtin.
+ *
+ * program: the name of the command
+ *
+ * Returns:
+ * 1 if the command is executed by the shell itself, 0 otherwise
+ */
+int is_builtin(const char *program) { return find_builtin(program) != NULL; }
+
+/* Determine how a command runs as a stage of a pipeline.
+ *
+ * node: the AST node of the stage
+ *
+ * Returns:
+ * how the builtin runs as a stage, or STAGE_FORK if the node is not a builtin
+ */
+enum builtin_stage builtin_stage(node_t *node) {
+    if (node->type != NODE_COMMAND) {
+        return STAGE_FORK;
+    }
+
+    const struct builtin *builtin = find_builtin(node->command.program);
+    return builtin == NULL ? STAGE_FORK : builtin->stage;
+}
+
+/* Run a simple command of which the arguments have been expanded.
+ *
+ * This function determines the type of simple command (a variable assignment, a builtin such as
+ * exit, cd, set, unset, or an external command) and executes it accordingly.
+ *
+ * node: the expanded AST node representing the simple command
+ *
+ * Returns:
+ * the exit status of the command
+ */
+int run_simple_command(node_t *node) {
+    // A command of the form NAME=value sets a variable that is local to the shell.
+    if (is_assignment(node)) {
+        const char *value = strchr(node->command.program, '=');
+        var_set(node->command.program, value - node->command.program, value + 1, 0);
+        return 0;
+    }
+
+    const struct builtin *builtin = find_builtin(node->command.program);
+    if (builtin == NULL) {
+        return execute_external_command(node);
+    }
+
+    int status = builtin->execute(node);
+    // Output of builtins must not end up after that of later commands, or in a forked child.
+    fflush(stdout);
+    return status;
 }
 
 /* Execute a simple command.
  *
- * This function determines the type of simple command (e.g., exit, cd, set, unset, external) and
- * executes it accordingly.
+ * The arguments are expanded, and the pipe ends of process substitutions are closed once the
+ * command is done. Expansion is the only thing in running a command that needs memory from the
+ * arena, so only then an arena is pushed; running other commands does not allocate at all.
  *
  * node: the AST node representing the simple command
+ *
+ * Returns:
+ * the exit status of the command
  */
-void execute_simple_command(node_t *node) {
-    if (strcmp(node->command.program, "exit") == 0) {
-        execute_exit_command(node);
-    } else if (strcmp(node->command.program, "cd") == 0) {
-        execute_cd_command(node);
-    } else if (strcmp(node->command.program, "set") == 0) {
-        execute_set_command(node);
-    } else if (strcmp(node->command.program, "unset") == 0) {
-        execute_unset_command(node);
-    } else {
-        execute_external_command(node);
+int execute_simple_command(node_t *node) {
+    size_t n_fds = n_substitution_fds;
+
+    if (!node->command.expand) {
+        return run_simple_command(node);
     }
+
+    arena_push();
+    int status = run_simple_command(expand_command(node));
+    close_substitutions(n_fds);
+    arena_pop();
+    return status;
 }
 
-/* Run a command.
+/* Execute a time command.
+ *
+ * This function runs a pipeline and reports what it cost: every process is reported with its
+ * resource usage when it finishes, followed by the total real, user and system time. time -p only
+ * reports the totals, in the format of POSIX.
+ *
+ * node: the AST node representing the time command
+ *
+ * Returns:
+ * the exit status of the pipeline
+ */
+int execute_time_command(node_t *node) {
+    struct job_usage usage;
+
+    fflush(stdout);
+    job_usage_begin(&usage, node->time.posix);
+    int status = run_command(node->time.child);
+    fflush(stdout);
+    job_usage_end(&usage);
+    return status;
+}
+
+/* Execute a command.
  *
  * This function dispatches the execution of different types of commands based on the type of the
- * AST node.
+ * AST node. The exit status of the command is kept for $?.
  *
  * node: the AST node representing the command to execute
+ *
+ * Returns:
+ * the exit status of the command
  */
-void run_command(node_t *node) {
-    arena_push();
+int execute_command(node_t *node) {
+    int status;
 
     switch (node->type) {
     case NODE_SEQUENCE:
-        execute_sequence_command(node);
+        status = execute_sequence_command(node);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        status = execute_and_or_command(node);
         break;
     case NODE_SUBSHELL:
-        execute_subshell_command(node);
+        status = execute_subshell_command(node);
         break;
     case NODE_PIPE:
-        execute_pipe_command(node);
+        status = execute_pipe_command(node);
         break;
     case NODE_DETACH:
-        execute_detach_command(node);
+        status = execute_detach_command(node);
         break;
     case NODE_REDIRECT:
-        execute_redirect_command(node);
+        status = execute_redirect_command(node);
         break;
     case NODE_COMMAND:
-        execute_simple_command(node);
+        status = execute_simple_command(node);
+        break;
+    case NODE_TIME:
+        status = execute_time_command(node);
+        break;
+    case NODE_PARALLEL:
+        status = execute_parallel_command(node);
         break;
     default:
         perror("Invalid command type");
         exit(EXIT_FAILURE);
     }
 
-    arena_pop();
+    last_status = status;
+    return status;
+}
+
+/* Run a command.
+ *
+ * This function executes a command, through the execution trace if tracing is enabled. When it is
+ * not, this costs a single branch.
+ *
+ * node: the AST node representing the command to run
+ *
+ * Returns:
+ * the exit status of the command
+ */
+int run_command(node_t *node) {
+    if (trace_fd == -1) {
+        return execute_command(node);
+    }
+    return trace_command(node, execute_command);
 }
@@ -22,9 +22,15 @@ void initialize(void);
 void shell_exit(void);
 
 /*
- * Called when a command has been read from the user.
+ * The exit status of the last command, as shown by $?.
  */
-void run_command(struct tree_node *n);
+extern int last_status;
+
+/*
+ * Called when a command has been read from the user. Returns the exit status
+ * of the command.
+ */
+int run_command(struct tree_node *n);
 
 /* ... */
 
@@ -0,0 +1,207 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the spawn backend of the shell. Instead of duplicating the whole shell with
+ * fork() only to replace it with execvp() right away, external commands are started with
+ * posix_spawnp(). On Linux this uses a vfork-style clone, so the cost of starting a command no
+ * longer depends on the size of the shell process. Programs are looked up in the command hash
+ * instead of letting posix_spawnp() search $PATH for every command.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "spawn.h"
+#include "command_hash.h"
+#include "vars.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// The number of file actions spawn_dup_actions() keeps.
+#define DUP_ACTIONS_SLOTS 4
+
+/* File actions that duplicate two descriptors onto stdin and stdout. */
+struct dup_actions {
+    int valid;
+    int in_fd;
+    int out_fd;
+    posix_spawn_file_actions_t actions;
+};
+
+int use_spawn = 1;
+struct spawn_stats spawn_stats;
+
+static struct dup_actions dup_actions[DUP_ACTIONS_SLOTS];
+static size_t next_dup_actions = 0;
+
+/* Get the time on the monotonic clock.
+ *
+ * Returns:
+ * the time in nanoseconds
+ */
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Note the time right before a process is started, in spawn_stats.began.
+ *
+ * Returns:
+ * the time in nanoseconds
+ */
+static long long begin_process(void) {
+    clock_gettime(CLOCK_MONOTONIC, &spawn_stats.began);
+    return spawn_stats.began.tv_sec * 1000000000LL + spawn_stats.began.tv_nsec;
+}
+
+pid_t fork_process(void) {
+    long long start = begin_process();
+    pid_t pid = fork();
+
+    if (pid > 0) {
+        spawn_stats.processes++;
+        spawn_stats.ns += now_ns() - start;
+    }
+    return pid;
+}
+
+/* Build the argument vector to run a script without a "#!" line with /bin/sh, as execvp() does:
+ * the shell gets the path of the script, followed by the arguments.
+ *
+ * path: the path of the script
+ * argv: the NULL-terminated argument vector of the script
+ *
+ * Returns:
+ * the argument vector, which the caller must free, or NULL if out of memory
+ */
+static char **script_argv(const char *path, char **argv) {
+    size_t argc = 0;
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+
+    char **sh_argv = malloc((argc + 2) * sizeof(char *));
+    if (sh_argv != NULL) {
+        sh_argv[0] = "/bin/sh";
+        sh_argv[1] = (char *)path;
+        for (size_t i = 1; i <= argc; i++) {
+            sh_argv[i + 1] = argv[i];
+        }
+    }
+    return sh_argv;
+}
+
+void exec_program(const char *path, char **argv) {
+    execve(path, argv, vars_envp());
+    if (errno == ENOEXEC) {
+        char **sh_argv = script_argv(path, argv);
+        if (sh_argv != NULL) {
+            execve("/bin/sh", sh_argv, vars_envp());
+            int err = errno;
+            free(sh_argv);
+            errno = err;
+        }
+    }
+}
+
+/* Start an external command using posix_spawn.
+ *
+ * argv: the NULL-terminated argument vector, argv[0] is the program to start
+ * actions: the file actions to apply in the child, or NULL
+ * pgid: the process group to put the child in, 0 for a new group, or -1 to keep the shell's group
+ *
+ * Returns:
+ * the pid of the child process, or -1 if the program could not be started
+ */
+pid_t spawn_command(char **argv, const posix_spawn_file_actions_t *actions, pid_t pgid) {
+    posix_spawnattr_t attr;
+    sigset_t default_signals, no_signals;
+    const char *path;
+    pid_t pid;
+    int err = ENOENT;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+
+    // The shell itself ignores these signals, the command should not. The shell may also have
+    // blocked SIGCHLD while it starts a job.
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGINT);
+    sigaddset(&default_signals, SIGTSTP);
+    sigaddset(&default_signals, SIGTTIN);
+    sigaddset(&default_signals, SIGTTOU);
+    sigemptyset(&no_signals);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigdefault(&attr, &default_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    if (pgid != -1) {
+        posix_spawnattr_setpgroup(&attr, pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    path = command_hash_lookup(argv[0]);
+    long long start = begin_process();
+    if (path != NULL) {
+        err = posix_spawn(&pid, path, actions, &attr, argv, vars_envp());
+
+        // The cached path may be stale, e.g. because the program was moved. Search once more.
+        if (err == ENOENT && path != argv[0]) {
+            command_hash_forget(argv[0]);
+            path = command_hash_lookup(argv[0]);
+            if (path != NULL) {
+                err = posix_spawn(&pid, path, actions, &attr, argv, vars_envp());
+            }
+        }
+        if (err == ENOEXEC) {
+            char **sh_argv = script_argv(path, argv);
+            err = sh_argv == NULL
+                      ? ENOMEM
+                      : posix_spawn(&pid, "/bin/sh", actions, &attr, sh_argv, vars_envp());
+            free(sh_argv);
+        }
+    }
+    posix_spawnattr_destroy(&attr);
+
+    if (err != 0) {
+        errno = err;
+        perror(argv[0]);
+        return -1;
+    }
+
+    spawn_stats.processes++;
+    spawn_stats.ns += now_ns() - start;
+    return pid;
+}
+
+const posix_spawn_file_actions_t *spawn_dup_actions(int in_fd, int out_fd) {
+    for (size_t i = 0; i < DUP_ACTIONS_SLOTS; i++) {
+        if (dup_actions[i].valid && dup_actions[i].in_fd == in_fd &&
+            dup_actions[i].out_fd == out_fd) {
+            return &dup_actions[i].actions;
+        }
+    }
+
+    // Replace the oldest actions.
+    struct dup_actions *slot = &dup_actions[next_dup_actions];
+    next_dup_actions = (next_dup_actions + 1) % DUP_ACTIONS_SLOTS;
+    if (slot->valid) {
+        posix_spawn_file_actions_destroy(&slot->actions);
+    }
+
+    posix_spawn_file_actions_init(&slot->actions);
+    if (in_fd != -1) {
+        posix_spawn_file_actions_adddup2(&slot->actions, in_fd, STDIN_FILENO);
+    }
+    if (out_fd != -1) {
+        posix_spawn_file_actions_adddup2(&slot->actions, out_fd, STDOUT_FILENO);
+    }
+    slot->valid = 1;
+    slot->in_fd = in_fd;
+    slot->out_fd = out_fd;
+    return &slot->actions;
+}
@@ -0,0 +1,66 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <spawn.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * When non-zero, external commands are started with posix_spawn(3) instead of
+ * fork(2) + execvp(3). Cleared by the -f command-line option.
+ */
+extern int use_spawn;
+
+/*
+ * Start the program argv[0] (looked up in the command hash) with the given
+ * argument vector without copying the address space of the shell. The file
+ * actions in `actions` (may be NULL) are applied in the child before the
+ * program starts. The signals the shell ignores are reset to their default
+ * disposition in the child, and no signals are blocked. The child joins
+ * process group `pgid` (0 for a new group), or stays in the process group of
+ * the shell when `pgid` is -1.
+ *
+ * Returns the pid of the child, or -1 after printing an error.
+ */
+pid_t spawn_command(char **argv, const posix_spawn_file_actions_t *actions, pid_t pgid);
+
+/*
+ * Replace the process with the program at `path`, like execv(3) with the
+ * environment of the shell. A program the kernel can not execute, like a
+ * script without a "#!" line, is run with /bin/sh, as execvp(3) does.
+ * spawn_command() does the same.
+ *
+ * Only returns on failure, with errno set.
+ */
+void exec_program(const char *path, char **argv);
+
+/*
+ * File actions that duplicate `in_fd` onto the standard input and `out_fd`
+ * onto the standard output of the child (-1 to leave a stream alone), for a
+ * stage of a pipeline. Building file actions allocates memory, so the actions
+ * for the last few pairs of descriptors are kept: a pipeline that runs again
+ * gets the same pipe descriptors, and so the same actions. The actions stay
+ * valid until the next call.
+ */
+const posix_spawn_file_actions_t *spawn_dup_actions(int in_fd, int out_fd);
+
+/*
+ * The processes the shell has started, and the time it spent in fork() and
+ * posix_spawn() to start them, for the bench builtin. A spawned process has
+ * already replaced itself with the program when posix_spawn() returns, a
+ * forked one has not even started yet. `began` is the time on the monotonic
+ * clock right before the last fork() or posix_spawn() call, for the trace.
+ */
+struct spawn_stats {
+    unsigned long processes;
+    long long ns;
+    struct timespec began;
+};
+extern struct spawn_stats spawn_stats;
+
+/*
+ * Fork the shell, like fork(2), and count the child in spawn_stats.
+ */
+pid_t fork_process(void);
+
+#endif
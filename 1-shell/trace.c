@@ -0,0 +1,180 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the execution trace of the shell. When it is enabled with -t FD, every node
+ * that run_command() executes and every process the shell starts is written to file descriptor FD
+ * as one JSON object per line, with timestamps in nanoseconds on the monotonic clock. Node records
+ * point to the node they are part of and process records to the node that started them, so a
+ * timeline of a whole script can be built from the trace.
+ *
+ * Each record is written with a single write() call, so the records of forked copies of the shell
+ * that trace to the same file descriptor do not get mixed up. Node ids are only unique per pid.
+ */
+
+#define _GNU_SOURCE
+
+#include "trace.h"
+#include "parser/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int trace_fd = -1;
+unsigned long trace_id = 0;
+
+static unsigned long last_id = 0;
+static int depth = 0;
+
+/* The names of the node types, as they appear in the trace. */
+static const char *const node_names[] = {
+    [NODE_COMMAND] = "command", [NODE_PIPE] = "pipe",       [NODE_REDIRECT] = "redirect",
+    [NODE_SUBSHELL] = "subshell", [NODE_SEQUENCE] = "sequence", [NODE_DETACH] = "detach",
+    [NODE_AND] = "and",         [NODE_OR] = "or",           [NODE_TIME] = "time",
+    [NODE_PARALLEL] = "parallel",
+};
+
+/* Convert a point on the monotonic clock to nanoseconds.
+ *
+ * ts: the point
+ *
+ * Returns:
+ * the point in nanoseconds
+ */
+static long long to_ns(const struct timespec *ts) { return ts->tv_sec * 1000000000LL + ts->tv_nsec; }
+
+/* Read the monotonic clock.
+ *
+ * Returns:
+ * the current time in nanoseconds
+ */
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return to_ns(&ts);
+}
+
+/* Print a word as a JSON string. A marked character is printed with a backslash, the escape it was
+ * read from.
+ *
+ * f: the stream to print to
+ * s: the word
+ */
+static void print_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == LITERAL_MARK && s[1] != '\0') {
+            fputs("\\\\", f);
+            c = *++s;
+        }
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/* Print the type of a node, and its arguments if it is a simple command.
+ *
+ * f: the stream to print to
+ * node: the node
+ */
+static void print_node(FILE *f, const node_t *node) {
+    fprintf(f, "\"node\":\"%s\"", node_names[node->type]);
+    if (node->type == NODE_COMMAND) {
+        fprintf(f, ",\"argv\":[");
+        for (size_t i = 0; i < node->command.argc; i++) {
+            if (i != 0) {
+                fputc(',', f);
+            }
+            print_json_string(f, node->command.argv[i]);
+        }
+        fputc(']', f);
+    }
+}
+
+/* Open a stream for a new record.
+ *
+ * buf: set to the buffer of the record
+ * size: set to the size of the record
+ *
+ * Returns:
+ * the stream, or NULL if it could not be opened
+ */
+static FILE *begin_record(char **buf, size_t *size) {
+    FILE *f = open_memstream(buf, size);
+
+    if (f == NULL) {
+        perror("open_memstream");
+    }
+    return f;
+}
+
+/* Write a record to the trace with a single write() and free it.
+ *
+ * f: the stream of the record
+ * buf: the buffer of the record
+ * size: the size of the record
+ */
+static void end_record(FILE *f, char **buf, size_t *size) {
+    fputs("}\n", f);
+    fclose(f);
+    if (write(trace_fd, *buf, *size) == -1) {
+        perror("trace");
+    }
+    free(*buf);
+}
+
+int trace_command(node_t *node, int (*run)(node_t *node)) {
+    unsigned long parent = trace_id;
+    unsigned long id = ++last_id;
+    long long start = now_ns();
+
+    trace_id = id;
+    depth++;
+    int status = run(node);
+    depth--;
+    trace_id = parent;
+
+    long long end = now_ns();
+    char *buf;
+    size_t size;
+    FILE *f = begin_record(&buf, &size);
+    if (f == NULL) {
+        return status;
+    }
+    fprintf(f, "{\"type\":\"node\",\"id\":%lu,\"parent\":%lu,\"depth\":%d,\"pid\":%d,", id, parent,
+            depth, (int)getpid());
+    print_node(f, node);
+    fprintf(f, ",\"start\":%lld,\"end\":%lld,\"status\":%d", start, end, status);
+    end_record(f, &buf, &size);
+
+    return status;
+}
+
+void trace_process(unsigned long parent, pid_t pid, const node_t *node,
+                   const struct timespec *spawn, const struct timespec *start,
+                   const struct timespec *end, const struct timespec *waited, int status) {
+    char *buf;
+    size_t size;
+    FILE *f = begin_record(&buf, &size);
+
+    if (f == NULL) {
+        return;
+    }
+    fprintf(f, "{\"type\":\"process\",\"parent\":%lu,\"pid\":%d,", parent, (int)pid);
+    if (node != NULL) {
+        print_node(f, node);
+        fputc(',', f);
+    }
+    fprintf(f, "\"spawn\":%lld,\"start\":%lld,\"end\":%lld,\"waited\":%lld,\"status\":%d",
+            to_ns(spawn), to_ns(start), to_ns(end), to_ns(waited), status);
+    end_record(f, &buf, &size);
+}
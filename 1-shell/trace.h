@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+struct tree_node;
+
+/*
+ * The file descriptor execution trace records are written to, or -1 when
+ * tracing is disabled. Set by the -t command-line option.
+ */
+extern int trace_fd;
+
+/*
+ * The id of the traced node that is running, 0 if none. Processes started for
+ * the node are recorded with this id as their parent.
+ */
+extern unsigned long trace_id;
+
+/*
+ * Run the command `node` with `run`, and write a record for it to trace_fd
+ * once it has finished: its type, its arguments for a simple command, the id
+ * of the node it is part of, the pid of the shell that ran it, its start and
+ * end time on the monotonic clock and its exit status. Only called when
+ * tracing is enabled.
+ *
+ * Returns the exit status returned by `run`.
+ */
+int trace_command(struct tree_node *node, int (*run)(struct tree_node *node));
+
+/*
+ * Write a record for a process of the node with id `parent` that has finished:
+ * its pid, the command it ran (may be NULL if no longer known), its exit status
+ * and four times on the monotonic clock: right before the shell called fork()
+ * or posix_spawn() (spawn), when that call returned (start), when the process
+ * was reaped (end) and when the shell was done waiting for its job (waited).
+ * Only called when tracing is enabled.
+ */
+void trace_process(unsigned long parent, pid_t pid, const struct tree_node *node,
+                   const struct timespec *spawn, const struct timespec *start,
+                   const struct timespec *end, const struct timespec *waited, int status);
+
+#endif
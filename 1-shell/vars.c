@@ -0,0 +1,219 @@
+/* Name: Daan Rosendal
+ * Student number: 15229394
+ * Study: Bachelor HBO-ICT (Software Engineering) at Windesheim in Zwolle. I follow Operating
+ * Systems as a "bijvak".
+ *
+ * This file contains the variable table of the shell. Variables are kept in a hash table owned by
+ * the shell instead of in the environment of libc, and every variable is either exported (passed
+ * to the commands the shell starts) or local to the shell. Each variable is stored as a single
+ * "NAME=value" string, so the environment of a command is just an array of pointers to the
+ * strings of the exported variables. That array is cached and only rebuilt when an exported
+ * variable has changed, instead of copying the environment for every command.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "vars.h"
+#include "command_hash.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The number of buckets in the hash table. A typical environment has a few dozen variables.
+#define VARS_HASH_SIZE 128
+
+extern char **environ;
+
+/* A variable, stored in a singly linked list per bucket. */
+struct var {
+    struct var *next;
+    char *entry; // "NAME=value"
+    size_t name_len;
+    int exported;
+};
+
+static struct var *table[VARS_HASH_SIZE];
+static size_t n_exported = 0;
+static char **envp = NULL;
+static int envp_dirty = 1;
+
+/* Compute the bucket of a variable name using the djb2 string hash.
+ *
+ * name: the name
+ * len: the length of the name
+ *
+ * Returns:
+ * the index of the bucket
+ */
+static size_t bucket_of(const char *name, size_t len) {
+    unsigned long hash = 5381;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = hash * 33 + (unsigned char)name[i];
+    }
+
+    return hash % VARS_HASH_SIZE;
+}
+
+/* Find the link that points to a variable.
+ *
+ * name: the name
+ * len: the length of the name
+ *
+ * Returns:
+ * the link that points to the variable, or the link at the end of its bucket if it is not set
+ */
+static struct var **find_link(const char *name, size_t len) {
+    struct var **link = &table[bucket_of(name, len)];
+
+    while (*link != NULL) {
+        if ((*link)->name_len == len && memcmp((*link)->entry, name, len) == 0) {
+            return link;
+        }
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/* Note that a variable has changed.
+ *
+ * v: the variable
+ */
+static void changed(const struct var *v) {
+    if (v->exported) {
+        envp_dirty = 1;
+    }
+    // The command hash caches the result of searching $PATH.
+    if (v->name_len == 4 && memcmp(v->entry, "PATH", 4) == 0) {
+        command_hash_clear();
+    }
+}
+
+int var_valid_name(const char *name, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return 0;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *var_get_n(const char *name, size_t len) {
+    struct var *v = *find_link(name, len);
+    return v != NULL ? v->entry + v->name_len + 1 : NULL;
+}
+
+const char *var_get(const char *name) { return var_get_n(name, strlen(name)); }
+
+void var_set(const char *name, size_t len, const char *value, int export) {
+    size_t value_len = strlen(value);
+    char *entry = malloc(len + value_len + 2);
+    if (entry == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry, name, len);
+    entry[len] = '=';
+    memcpy(entry + len + 1, value, value_len + 1);
+
+    struct var **link = find_link(name, len);
+    struct var *v = *link;
+    if (v == NULL) {
+        v = calloc(1, sizeof(struct var));
+        if (v == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        v->name_len = len;
+        *link = v;
+    } else {
+        free(v->entry);
+    }
+    v->entry = entry;
+    if (export && !v->exported) {
+        v->exported = 1;
+        n_exported++;
+    }
+    changed(v);
+}
+
+void var_export(const char *name) {
+    struct var *v = *find_link(name, strlen(name));
+
+    if (v != NULL && !v->exported) {
+        v->exported = 1;
+        n_exported++;
+        changed(v);
+    }
+}
+
+void var_unset(const char *name) {
+    struct var **link = find_link(name, strlen(name));
+    struct var *v = *link;
+
+    if (v == NULL) {
+        return;
+    }
+    *link = v->next;
+    if (v->exported) {
+        n_exported--;
+    }
+    changed(v);
+    free(v->entry);
+    free(v);
+}
+
+void vars_init(void) {
+    for (char **e = environ; *e != NULL; e++) {
+        const char *eq = strchr(*e, '=');
+        if (eq != NULL) {
+            var_set(*e, eq - *e, eq + 1, 1);
+        }
+    }
+}
+
+char **vars_envp(void) {
+    if (!envp_dirty) {
+        return envp;
+    }
+
+    free(envp);
+    envp = malloc((n_exported + 1) * sizeof(char *));
+    if (envp == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < VARS_HASH_SIZE; i++) {
+        for (struct var *v = table[i]; v != NULL; v = v->next) {
+            if (v->exported) {
+                envp[n++] = v->entry;
+            }
+        }
+    }
+    envp[n] = NULL;
+    envp_dirty = 0;
+    return envp;
+}
+
+void vars_free(void) {
+    for (size_t i = 0; i < VARS_HASH_SIZE; i++) {
+        struct var *v = table[i];
+        while (v != NULL) {
+            struct var *next = v->next;
+            free(v->entry);
+            free(v);
+            v = next;
+        }
+        table[i] = NULL;
+    }
+    free(envp);
+    envp = NULL;
+    envp_dirty = 1;
+    n_exported = 0;
+}
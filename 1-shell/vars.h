@@ -0,0 +1,62 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+
+/*
+ * Fill the variable table with the environment the shell was started with.
+ * All of these variables are exported. Called once when the shell starts.
+ */
+void vars_init(void);
+
+/*
+ * Check whether the `len` bytes at `name` are a valid variable name: a letter
+ * or underscore, followed by letters, digits and underscores.
+ */
+int var_valid_name(const char *name, size_t len);
+
+/*
+ * Look up the variable whose name is the `len` bytes at `name`.
+ *
+ * Returns its value, or NULL if it is not set. The value is owned by the
+ * table and is only valid until the variable is changed.
+ */
+const char *var_get_n(const char *name, size_t len);
+
+/*
+ * Look up the variable `name`, like var_get_n().
+ */
+const char *var_get(const char *name);
+
+/*
+ * Set the variable whose name is the `len` bytes at `name` to `value`. The
+ * variable is exported if `export` is non-zero or if it was exported
+ * already; a new variable is local to the shell otherwise.
+ */
+void var_set(const char *name, size_t len, const char *value, int export);
+
+/*
+ * Export the variable `name`, so it is passed to the commands the shell
+ * starts. Nothing happens if it is not set.
+ */
+void var_export(const char *name);
+
+/*
+ * Remove the variable `name`.
+ */
+void var_unset(const char *name);
+
+/*
+ * The environment for the commands the shell starts: a NULL-terminated array
+ * of "NAME=value" strings of all exported variables. The array is only
+ * rebuilt after an exported variable has changed. It is owned by the table
+ * and is only valid until a variable is changed.
+ */
+char **vars_envp(void);
+
+/*
+ * Free all variables. Called when the shell exits.
+ */
+void vars_free(void);
+
+#endif